@@ -0,0 +1,80 @@
+#!/bin/sh
+
+# Generates a synthetic tree and runs this find and GNU find over it in a
+# number of scenarios, printing one JSON object per scenario and
+# implementation. The tree is configured through the environment:
+#
+#   FIND      find to benchmark (bin/find)
+#   GNU_FIND  find to compare against (find)
+#   BENCH_DIR where to put the tree (/tmp/find-bench)
+#   FANOUT, DEPTH, FILES, LOOPS, SPLITS, SEED  passed on to gentree
+#   RUNS      timed runs per scenario, the best is reported (3)
+#
+# Split directories are mounted as tmpfs file systems when permitted, so that
+# -xdev has something to skip, and stay plain directories otherwise.
+
+FIND=${FIND:-bin/find}
+GNU_FIND=${GNU_FIND:-find}
+BENCH_DIR=${BENCH_DIR:-/tmp/find-bench}
+FANOUT=${FANOUT:-4}
+DEPTH=${DEPTH:-6}
+FILES=${FILES:-10}
+LOOPS=${LOOPS:-4}
+SPLITS=${SPLITS:-2}
+SEED=${SEED:-1}
+RUNS=${RUNS:-3}
+
+BIN=$(dirname "$FIND")
+
+cleanup ()
+{
+  i=0
+  while [ "$i" -lt "$SPLITS" ]; do
+    umount "$BENCH_DIR/m$i" 2>/dev/null
+    i=$((i + 1))
+  done
+
+  rm -rf "$BENCH_DIR"
+}
+
+trap cleanup EXIT
+cleanup
+
+mkdir -p "$BENCH_DIR" || exit 1
+
+i=0
+while [ "$i" -lt "$SPLITS" ]; do
+  mkdir "$BENCH_DIR/m$i" || exit 1
+  mount -t tmpfs tmpfs "$BENCH_DIR/m$i" 2>/dev/null
+  i=$((i + 1))
+done
+
+"$BIN/gentree" "$BENCH_DIR" -f "$FANOUT" -d "$DEPTH" -n "$FILES" \
+  -l "$LOOPS" -s "$SPLITS" -S "$SEED" >&2 || exit 1
+
+# run <scenario> <impl> <find> [<expression> ...]
+run ()
+{
+  scenario=$1
+  impl=$2
+  find=$3
+  shift 3
+
+  printf '{"scenario": "%s", "impl": "%s", ' "$scenario" "$impl"
+  "$BIN/benchrun" -r "$RUNS" "$find" "$BENCH_DIR" "$@" || exit 1
+  printf '}\n'
+}
+
+for impl in find gnu; do
+  if [ "$impl" = find ]; then
+    f=$FIND
+  else
+    f=$GNU_FIND
+  fi
+
+  run walk "$impl" "$f"
+  run name "$impl" "$f" -name '*.c'
+  run type "$impl" "$f" -type d
+  run follow "$impl" "$f" -follow
+  run xdev "$impl" "$f" -xdev
+done
@@ -0,0 +1,278 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Runs a command a number of times and prints, as JSON object members, its
+// best wall clock time, its peak resident set size, the number of lines it
+// wrote to stdout and (in a separate, traced run) the number of system calls
+// made by all of its threads. stderr of the command is discarded.
+
+#define USAGE_MSG "Usage: %s [-r <runs>] <command> [<argument> ...]\n"
+
+#define MAX_THREADS 1024
+
+static char *prog_name;
+
+// start argv with stdout going to the returned pipe, or to /dev/null when
+// traced (a tracee blocked on a full pipe would never stop again)
+static pid_t
+start (char **argv, int trace, int *out_fd)
+{
+  int pipe_fd[2];
+  if (pipe (pipe_fd) == -1)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  pid_t pid = fork ();
+  if (pid == -1)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      close (pipe_fd[0]);
+      close (pipe_fd[1]);
+      return -1;
+    }
+
+  if (pid == 0)
+    {
+      int null_fd = open ("/dev/null", O_WRONLY);
+
+      dup2 (trace ? null_fd : pipe_fd[1], STDOUT_FILENO);
+      dup2 (null_fd, STDERR_FILENO);
+
+      close (pipe_fd[0]);
+      close (pipe_fd[1]);
+      close (null_fd);
+
+      if (trace && ptrace (PTRACE_TRACEME, 0, NULL, NULL) == -1)
+        _exit (127);
+
+      execvp (argv[0], argv);
+      _exit (127);
+    }
+
+  close (pipe_fd[1]);
+
+  if (trace)
+    close (pipe_fd[0]);
+  else
+    *out_fd = pipe_fd[0];
+
+  return pid;
+}
+
+// read the command's output, returns the number of lines
+static unsigned long
+drain (int fd)
+{
+  char buf[64 * 1024];
+  unsigned long lines = 0;
+
+  for (;;)
+    {
+      ssize_t n = read (fd, buf, sizeof (buf));
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+
+      for (char *p = buf; (p = memchr (p, '\n', buf + n - p)); ++p)
+        ++lines;
+    }
+
+  close (fd);
+
+  return lines;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// run argv once, returns its exit status or -1
+static int
+timed_run (char **argv, double *wall, long *max_rss, unsigned long *lines)
+{
+  double t0 = now ();
+
+  int out_fd;
+  pid_t pid = start (argv, 0, &out_fd);
+  if (pid == -1)
+    return -1;
+
+  *lines = drain (out_fd);
+
+  int status;
+  struct rusage ru;
+
+  while (wait4 (pid, &status, 0, &ru) == -1)
+    {
+      if (errno != EINTR)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+    }
+
+  *wall = now () - t0;
+  *max_rss = ru.ru_maxrss;
+
+  return WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+}
+
+// per thread state of the traced run
+static struct
+{
+  pid_t tid;
+  int in_syscall;
+} threads[MAX_THREADS];
+
+static int n_threads;
+
+static int *
+in_syscall (pid_t tid)
+{
+  for (int i = 0; i < n_threads; ++i)
+    {
+      if (threads[i].tid == tid)
+        return &threads[i].in_syscall;
+    }
+
+  if (n_threads == MAX_THREADS)
+    return NULL;
+
+  threads[n_threads].tid = tid;
+  threads[n_threads].in_syscall = 0;
+
+  return &threads[n_threads++].in_syscall;
+}
+
+// run argv under ptrace, returns the number of system calls or -1
+static long
+count_syscalls (char **argv)
+{
+  pid_t pid = start (argv, 1, NULL);
+  if (pid == -1)
+    return -1;
+
+  // the child stops at exec
+  int status;
+  if (waitpid (pid, &status, 0) == -1 || !WIFSTOPPED (status))
+    {
+      fprintf (stderr, "%s: cannot trace '%s'\n", prog_name, argv[0]);
+      return -1;
+    }
+
+  ptrace (PTRACE_SETOPTIONS, pid, NULL,
+          (void *) (long) (PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE
+                           | PTRACE_O_EXITKILL));
+  ptrace (PTRACE_SYSCALL, pid, NULL, NULL);
+
+  long calls = 0;
+  int live = 1;
+
+  while (live > 0)
+    {
+      pid_t tid = waitpid (-1, &status, __WALL);
+      if (tid == -1)
+        {
+          if (errno == EINTR)
+            continue;
+
+          break;
+        }
+
+      if (WIFEXITED (status) || WIFSIGNALED (status))
+        {
+          --live;
+          continue;
+        }
+
+      int sig = WSTOPSIG (status);
+      int forward = 0;
+
+      if (sig == (SIGTRAP | 0x80))
+        {
+          // syscall stops alternate between entry and exit per thread
+          int *state = in_syscall (tid);
+          if (state && (*state = !*state))
+            ++calls;
+        }
+      else if (status >> 16 == PTRACE_EVENT_CLONE)
+        ++live;
+      else if (sig != SIGTRAP && sig != SIGSTOP)
+        forward = sig;
+
+      ptrace (PTRACE_SYSCALL, tid, NULL, (void *) (long) forward);
+    }
+
+  return calls;
+}
+
+int
+main (int argc, char **argv)
+{
+  prog_name = argv[0];
+
+  int runs = 3;
+  int first = 1;
+
+  if (argc > 2 && strcmp (argv[1], "-r") == 0)
+    {
+      runs = atoi (argv[2]);
+      first = 3;
+    }
+
+  if (first >= argc || runs < 1)
+    {
+      fprintf (stderr, USAGE_MSG, prog_name);
+      exit (EXIT_FAILURE);
+    }
+
+  char **cmd = argv + first;
+
+  double best = 0;
+  long max_rss = 0;
+  unsigned long lines = 0;
+  int status = 0;
+
+  for (int i = 0; i < runs; ++i)
+    {
+      double wall;
+      long rss;
+
+      status = timed_run (cmd, &wall, &rss, &lines);
+      if (status == -1)
+        exit (EXIT_FAILURE);
+
+      if (i == 0 || wall < best)
+        best = wall;
+
+      if (rss > max_rss)
+        max_rss = rss;
+    }
+
+  long calls = count_syscalls (cmd);
+
+  printf ("\"wall_s\": %.6f, \"max_rss_kb\": %ld, \"syscalls\": %ld, "
+          "\"lines\": %lu, \"status\": %d", best, max_rss, calls, lines,
+          status);
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Generates a synthetic directory tree for benchmarking find. The tree is a
+// full tree of the given fan-out and depth whose directories each hold the
+// given number of files, a mix of regular files with different extensions
+// and symlinks to them. Some directories get a symlink to their parent,
+// which forms a loop under -follow, and the top level gets additional split
+// directories (m0, m1, ...) which the benchmark script turns into mount
+// points where possible. Names and file kinds only depend on the seed, so
+// the same arguments always produce the same tree.
+
+#define USAGE_MSG "Usage: %s <directory name> [-f <fan-out>] [-d <depth>] [-n <files per directory>] [-l <loops>] [-s <splits>] [-S <seed>]\n"
+
+static char *prog_name;
+
+static unsigned fanout = 4, depth = 6, files = 10, loops = 0, splits = 0;
+static uint64_t seed = 1;
+
+static unsigned long n_dirs, n_files, n_links;
+
+static uint64_t
+next_rand (void)
+{
+  // xorshift64*
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+
+  return seed * 0x2545f4914f6cdd1dULL;
+}
+
+static int
+make_dir (int parent_fd, char const *name)
+{
+  if (mkdirat (parent_fd, name, 0755) == -1 && errno != EEXIST)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, name, strerror (errno));
+      return -1;
+    }
+
+  int fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY);
+  if (fd == -1)
+    fprintf (stderr, "%s: %s: %s\n", prog_name, name, strerror (errno));
+
+  ++n_dirs;
+
+  return fd;
+}
+
+static int
+make_files (int fd)
+{
+  static char const *const exts[] = { ".c", ".h", ".txt", ".o", "" };
+
+  char name[64];
+
+  for (unsigned i = 0; i < files; ++i)
+    {
+      // every eighth file is a symlink to the first one
+      if (i > 0 && i % 8 == 0)
+        {
+          snprintf (name, sizeof (name), "l%u", i);
+
+          if (symlinkat ("f0.c", fd, name) == -1 && errno != EEXIST)
+            {
+              fprintf (stderr, "%s: %s: %s\n", prog_name, name,
+                       strerror (errno));
+              return -1;
+            }
+
+          ++n_links;
+          continue;
+        }
+
+      // the first file is always a .c file, the symlinks point to it
+      char const *ext = i == 0 ? exts[0] : exts[next_rand () % 5];
+      snprintf (name, sizeof (name), "f%u%s", i, ext);
+
+      int file_fd = openat (fd, name, O_WRONLY | O_CREAT, 0644);
+      if (file_fd == -1)
+        {
+          fprintf (stderr, "%s: %s: %s\n", prog_name, name, strerror (errno));
+          return -1;
+        }
+
+      // a few bytes of varying size, enough for -size to tell files apart
+      char buf[512];
+      memset (buf, 'x', sizeof (buf));
+
+      if (write (file_fd, buf, next_rand () % sizeof (buf)) == -1)
+        {
+          fprintf (stderr, "%s: %s: %s\n", prog_name, name, strerror (errno));
+          close (file_fd);
+          return -1;
+        }
+
+      close (file_fd);
+      ++n_files;
+    }
+
+  return 0;
+}
+
+// fill the directory fd, which has levels more levels below it
+static int
+make_tree (int fd, unsigned levels)
+{
+  if (make_files (fd) != 0)
+    return -1;
+
+  if (levels == 0)
+    return 0;
+
+  char name[64];
+
+  for (unsigned i = 0; i < fanout; ++i)
+    {
+      snprintf (name, sizeof (name), "d%u", i);
+
+      int sub = make_dir (fd, name);
+      if (sub == -1)
+        return -1;
+
+      int err = make_tree (sub, levels - 1);
+
+      close (sub);
+
+      if (err != 0)
+        return -1;
+    }
+
+  return 0;
+}
+
+// add a symlink to the parent to a directory picked at random
+static int
+make_loop (int root_fd, unsigned i)
+{
+  int fd = dup (root_fd);
+  char name[64];
+
+  for (unsigned level = next_rand () % (depth + 1); level > 0; --level)
+    {
+      snprintf (name, sizeof (name), "d%u", (unsigned) (next_rand () % fanout));
+
+      int sub = openat (fd, name, O_RDONLY | O_DIRECTORY);
+      close (fd);
+
+      if (sub == -1)
+        {
+          fprintf (stderr, "%s: %s: %s\n", prog_name, name, strerror (errno));
+          return -1;
+        }
+
+      fd = sub;
+    }
+
+  snprintf (name, sizeof (name), "up%u", i);
+
+  int err = 0;
+
+  if (symlinkat ("..", fd, name) == -1 && errno != EEXIST)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, name, strerror (errno));
+      err = -1;
+    }
+  else
+    ++n_links;
+
+  close (fd);
+
+  return err;
+}
+
+static unsigned
+parse_arg (char const *opt, char const *arg)
+{
+  char *end = NULL;
+  unsigned long n = 0;
+
+  if (arg)
+    {
+      errno = 0;
+      n = strtoul (arg, &end, 10);
+    }
+
+  if (!arg || errno != 0 || *end || end == arg || n > 1000000)
+    {
+      fprintf (stderr, "%s: %s expects a number\n", prog_name, opt);
+      fprintf (stderr, USAGE_MSG, prog_name);
+      exit (EXIT_FAILURE);
+    }
+
+  return n;
+}
+
+int
+main (int argc, char **argv)
+{
+  prog_name = argv[0];
+
+  char const *root = NULL;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      char const *arg = argv[i];
+      char const *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+      if (arg[0] != '-' && !root)
+        {
+          root = arg;
+          continue;
+        }
+
+      if (strcmp (arg, "-f") == 0)
+        fanout = parse_arg (arg, val);
+      else if (strcmp (arg, "-d") == 0)
+        depth = parse_arg (arg, val);
+      else if (strcmp (arg, "-n") == 0)
+        files = parse_arg (arg, val);
+      else if (strcmp (arg, "-l") == 0)
+        loops = parse_arg (arg, val);
+      else if (strcmp (arg, "-s") == 0)
+        splits = parse_arg (arg, val);
+      else if (strcmp (arg, "-S") == 0)
+        seed = parse_arg (arg, val) | 1;
+      else
+        {
+          fprintf (stderr, USAGE_MSG, prog_name);
+          exit (EXIT_FAILURE);
+        }
+
+      ++i;
+    }
+
+  if (!root || fanout == 0)
+    {
+      fprintf (stderr, USAGE_MSG, prog_name);
+      exit (EXIT_FAILURE);
+    }
+
+  int root_fd = make_dir (AT_FDCWD, root);
+  if (root_fd == -1)
+    exit (EXIT_FAILURE);
+
+  int err = make_tree (root_fd, depth);
+
+  // split directories hold trees one level less deep
+  for (unsigned i = 0; i < splits && !err; ++i)
+    {
+      char name[64];
+      snprintf (name, sizeof (name), "m%u", i);
+
+      int fd = make_dir (root_fd, name);
+      if (fd == -1)
+        {
+          err = -1;
+          break;
+        }
+
+      err = make_tree (fd, depth > 0 ? depth - 1 : 0);
+      close (fd);
+    }
+
+  for (unsigned i = 0; i < loops && !err; ++i)
+    err = make_loop (root_fd, i);
+
+  close (root_fd);
+
+  if (err)
+    exit (EXIT_FAILURE);
+
+  printf ("%lu directories, %lu files, %lu symlinks\n", n_dirs, n_files,
+          n_links);
+
+  exit (EXIT_SUCCESS);
+}
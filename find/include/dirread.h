@@ -0,0 +1,34 @@
+#ifndef DIRREAD_H
+#define DIRREAD_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define DIR_BUF_SZ (64 * 1024)
+
+// reads directory entries in bulk via getdents64 into a reusable buffer
+struct dir_reader
+{
+  int fd;
+
+  char *buf;
+  size_t len, pos;
+
+  off_t off;  // directory offset following the entry returned last
+};
+
+struct dir_entry
+{
+  char const *name;     // points into the reader's buffer
+  unsigned char type;   // DT_* constant, may be DT_UNKNOWN
+  ino_t ino;
+};
+
+int dir_reader_init (struct dir_reader *dr);
+void dir_reader_free (struct dir_reader *dr);
+
+void dir_reader_reset (struct dir_reader *dr, int fd);
+int dir_reader_seek (struct dir_reader *dr, int fd, off_t off);
+int dir_read (struct dir_reader *dr, struct dir_entry *entry);
+
+#endif /* DIRREAD_H */
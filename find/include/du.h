@@ -0,0 +1,40 @@
+#ifndef DU_H
+#define DU_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "entry.h"
+#include "inoset.h"
+
+// disk usage of an entry or of the entries read from a directory
+struct du_sum
+{
+  uint64_t apparent;   // bytes
+  uint64_t allocated;  // bytes in allocated blocks
+};
+
+struct du_dir;
+
+// usage per directory collected by -du during the traversal
+struct du
+{
+  pthread_mutex_t lock;
+  struct ino_set links;  // files with several links counted already
+
+  struct du_dir *dirs;
+  size_t n_dirs, cap;
+
+  int max_depth;  // directories below are counted but not reported
+};
+
+int du_init (struct du *du, int max_depth);
+void du_free (struct du *du);
+
+int du_usage (struct du *du, struct entry *e, struct du_sum *usage);
+int du_add_dir (struct du *du, char const *path, int depth,
+                struct du_sum const *sum);
+int du_report (struct du *du, int fd, char term);
+
+#endif /* DU_H */
@@ -0,0 +1,32 @@
+#ifndef DUPES_H
+#define DUPES_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "inoset.h"
+
+struct dupe_file;
+
+// regular files collected by -dupes during the traversal
+struct dupes
+{
+  pthread_mutex_t lock;
+  struct ino_set seen;  // files already collected, under any name
+
+  struct dupe_file *files;
+  size_t n_files, cap;
+
+  int n_threads;  // threads hashing files
+};
+
+int dupes_init (struct dupes *d, int n_threads);
+void dupes_free (struct dupes *d);
+
+int dupes_add (struct dupes *d, char const *path, uint64_t size, dev_t dev,
+               ino_t ino);
+int dupes_report (struct dupes *d, int fd, char term);
+
+#endif /* DUPES_H */
@@ -0,0 +1,31 @@
+#ifndef ENTRY_H
+#define ENTRY_H
+
+#include "xstat.h"
+
+// directory entry being visited, stat data is only fetched on demand
+struct entry
+{
+  int parent_fd;
+  char const *name;     // relative to parent_fd
+  char const *path;
+
+  unsigned char ltype;  // DT_* type of the entry itself
+  unsigned char type;   // DT_* type after following symlinks with -follow
+  int follow;
+
+  // stat data of the entry, following symlinks with -follow, only the
+  // STATX_* fields in have are valid
+  struct linux_statx stx;
+  unsigned have;
+  unsigned want;        // fields fetched whenever stat data is needed
+
+  // set by actions during evaluation
+  int prune;            // do not descend into the entry
+  int print;            // -print was reached
+  int printed;          // already written out ahead of a command
+};
+
+int entry_stat (struct entry *e, unsigned mask);
+
+#endif /* ENTRY_H */
@@ -0,0 +1,32 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "entry.h"
+
+// command run by -exec, with -exec ... {} + paths are collected and passed to
+// the command in batches as large as the argument space allows
+struct exec_cmd
+{
+  char **argv;  // command, for batches without the trailing {}
+  int argc;
+  int batch;    // terminated by {} + rather than ;
+
+  pthread_mutex_t lock;  // guards the pending batch
+  char **args;           // argv followed by the collected paths
+  int n_args, cap;
+  size_t size;           // bytes the batch takes up in the argument space
+};
+
+void exec_set_procs (int n);
+
+int exec_cmd_init (struct exec_cmd *cmd, char **argv, int argc, int batch);
+void exec_cmd_free (struct exec_cmd *cmd);
+
+int exec_run (struct exec_cmd *cmd, struct entry *e);
+int exec_flush (struct exec_cmd *cmd);
+int exec_wait (void);
+
+#endif /* EXEC_H */
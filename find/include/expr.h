@@ -0,0 +1,129 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "entry.h"
+#include "exec.h"
+#include "grep.h"
+#include "match.h"
+#include "multimatch.h"
+
+// === Expression tree =========================================================
+
+enum expr_op
+{
+  EXPR_AND,
+  EXPR_OR,
+  EXPR_NOT,
+
+  // predicates not requiring stat data
+  EXPR_NAME,
+  EXPR_NAME_FROM,
+  EXPR_TYPE,
+
+  // actions
+  EXPR_PRUNE,
+  EXPR_PRINT,
+  EXPR_PRINTF,
+  EXPR_EXEC,
+
+  // predicates requiring stat data
+  EXPR_SIZE,
+  EXPR_MTIME,
+  EXPR_NEWER,
+  EXPR_PERM,
+  EXPR_USER,
+
+  // predicates reading file contents
+  EXPR_GREP
+};
+
+// comparison for numeric arguments given as +n, -n or n
+enum expr_cmp { CMP_LT = -1, CMP_EQ = 0, CMP_GT = 1 };
+
+// perm modes given as mode, -mode or /mode
+enum expr_perm { PERM_EXACT, PERM_ALL, PERM_ANY };
+
+struct expr
+{
+  enum expr_op op;
+  int cost;
+  int effects;  // the expression contains actions
+
+  struct expr *left, *right;  // operands of EXPR_AND, EXPR_OR and EXPR_NOT
+
+  union
+  {
+    struct matcher name;
+    struct multi_matcher names;
+    unsigned char type;
+
+    struct
+    {
+      enum expr_cmp cmp;
+      unsigned long long n;
+      unsigned long long unit;  // -size only
+    } num;
+
+    struct timespec newer;
+
+    struct
+    {
+      enum expr_perm how;
+      mode_t mode;
+    } perm;
+
+    uid_t uid;
+
+    struct grep_pattern grep;
+
+    struct exec_cmd *exec;
+
+    char const *format;  // -printf, taken from the tokens
+  } arg;
+};
+
+// === Compiled program ========================================================
+
+// targets of a jump that end evaluation
+enum { INSN_FALSE = -1, INSN_TRUE = -2 };
+
+// A program is a sequence of predicate tests, each of which continues at
+// next[0] if the test fails and at next[1] if it succeeds.
+struct insn
+{
+  struct expr const *test;
+  int next[2];
+};
+
+struct expr_prog
+{
+  struct expr *root;
+  time_t now;
+
+  struct insn *insns;
+  int n_insns;
+
+  int print;  // contains -print, -printf or -exec, entries are only printed
+              // by -print and -printf
+
+  // format of the only -printf, which prints entries the way -print does
+  // but in this format, NULL if there is none
+  char const *format;
+
+  unsigned stat_mask;  // STATX_* fields needed by the tests
+};
+
+int expr_arity (char const *arg, int argc, char **argv);
+
+int expr_compile (struct expr_prog *prog, int argc, char **argv);
+void expr_free (struct expr_prog *prog);
+
+int expr_needs_stat (struct expr_prog const *prog);
+int expr_flush (struct expr_prog const *prog);
+
+int expr_eval (struct expr_prog const *prog, struct entry *e);
+
+#endif /* EXPR_H */
@@ -0,0 +1,78 @@
+#ifndef FIND_H
+#define FIND_H
+
+#include <sys/types.h>
+
+#include "du.h"
+#include "expr.h"
+#include "inoset.h"
+
+struct dupes;
+struct format;
+struct walker;
+struct watcher;
+
+// === Options =================================================================
+
+struct find_opts
+{
+  struct expr_prog *expr;  // filter expression
+
+  int follow;     // -follow
+  int xdev;       // -xdev
+  dev_t dev;      // device of the starting point (for -xdev)
+  int print0;     // -print0, terminate paths with NUL instead of newline
+  struct format const *format;  // -printf or -format, NULL for plain paths
+
+  int min_depth;  // -mindepth, the expression is not applied above it
+  int max_depth;  // -maxdepth, directories at this depth are not read
+  int eval_depth; // the expression is not applied below it (-du only)
+
+  int n_threads;  // -j, 1 means sequential traversal
+  int ordered;    // -ordered, print in sequential order even if n_threads > 1
+
+  int inode_order;  // -inode-order, stat entries in inode order first
+  int uring;        // -uring, stat entries through io_uring first
+
+  struct watcher *watch;  // -watch, directories are watched before reading
+  struct dupes *dupes;    // -dupes, matching files are collected instead
+  struct du *du;          // -du, usage is added up per directory
+
+  // matching entries are passed to on_match instead of being printed, it
+  // returns non-zero to stop the traversal
+  int (*on_match) (struct entry *e, void *arg);
+  void *arg;
+};
+
+extern char const *prog_name;
+
+// === Traversal ===============================================================
+
+// flags returned by visit
+enum
+{
+  VISIT_MATCH = 1,   // entry satisfies the expression and should be printed
+  VISIT_DESCEND = 2  // entry is a directory that should be traversed
+};
+
+int open_dir (char const *path);
+
+unsigned entry_mask (struct find_opts const *opts);
+
+int visit (struct find_opts const *opts, int parent_fd, char const *file,
+           char const *path, unsigned char d_type,
+           struct linux_statx const *stx, int depth,
+           struct ino_set const *active, struct entry *e, dev_t *dev,
+           ino_t *ino, struct du_sum *usage);
+
+int find_seq (struct find_opts const *opts, char *root);
+int find_seq_at (struct find_opts const *opts, int parent_fd,
+                 char const *file, char const *root_path, int depth);
+int find_par (struct find_opts const *opts, char *root);
+
+struct walker *walker_open (struct find_opts const *opts, char const *root);
+int walker_next (struct walker *w, struct entry **e);
+void walker_prune (struct walker *w);
+void walker_close (struct walker *w);
+
+#endif /* FIND_H */
@@ -0,0 +1,43 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+
+#include "entry.h"
+
+// how matching entries are written out, plain paths are written without a
+// format
+enum format_kind
+{
+  FORMAT_PRINTF,  // -printf, fields and text as given by the format string
+  FORMAT_NDJSON,  // one JSON object per line
+  FORMAT_BINARY   // length-prefixed records in host byte order
+};
+
+// piece of a -printf format, literal text or (if field is set) a directive
+struct format_item
+{
+  char field;  // directive letter, '@' for %T@, 0 for text
+  char const *text;
+  size_t len;
+};
+
+struct format
+{
+  enum format_kind kind;
+
+  struct format_item *items;  // FORMAT_PRINTF only
+  int n_items;
+  char *text;                 // unescaped text of the items
+
+  unsigned stat_mask;  // STATX_* fields the records are built from
+};
+
+int format_init (struct format *f, enum format_kind kind, char const *fmt);
+void format_free (struct format *f);
+
+size_t format_max (struct format const *f, size_t path_len);
+size_t format_entry (struct format const *f, struct entry const *e,
+                     size_t path_len, char *buf);
+
+#endif /* FORMAT_H */
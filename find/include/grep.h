@@ -0,0 +1,19 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <stddef.h>
+
+// fixed string searched for in file contents by -grep
+struct grep_pattern
+{
+  char *str;
+  size_t len;
+};
+
+int grep_compile (struct grep_pattern *g, char const *pattern);
+void grep_free (struct grep_pattern *g);
+
+int grep_file (struct grep_pattern const *g, int dirfd, char const *name,
+               char const *path, int follow);
+
+#endif /* GREP_H */
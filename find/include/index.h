@@ -0,0 +1,27 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "find.h"
+
+// An index file starts with the magic INDEX_MAGIC followed by one record per
+// entry below (and including) the indexed directory. Records are in pre-order
+// with the entries of every directory sorted by name, so that all paths are
+// ordered bytewise with '/' sorting before any other character. Each record
+// is front coded against the path of the previous one:
+//
+//   varint  length of the prefix shared with the previous path
+//   varint  length of the remaining suffix
+//   bytes   suffix
+//   byte    DT_* type of the entry (symlinks are not followed)
+//   varint  mtime seconds   (directories only)
+//   varint  mtime nanoseconds (directories only)
+//
+// Directories not descended into (because of -xdev) have an mtime of zero.
+
+#define INDEX_MAGIC "FINDIDX1"
+
+int index_build (struct find_opts const *opts, char const *root,
+                 char const *file);
+int index_query (struct find_opts const *opts, char const *file);
+
+#endif /* INDEX_H */
@@ -0,0 +1,21 @@
+#ifndef INOSET_H
+#define INOSET_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// hash set of (dev, ino) pairs
+struct ino_set
+{
+  struct ino_slot *slots;
+  size_t sz, used;
+};
+
+int ino_set_init (struct ino_set *set);
+void ino_set_free (struct ino_set *set);
+
+int ino_set_insert (struct ino_set *set, dev_t dev, ino_t ino);
+int ino_set_contains (struct ino_set const *set, dev_t dev, ino_t ino);
+void ino_set_remove (struct ino_set *set, dev_t dev, ino_t ino);
+
+#endif /* INOSET_H */
@@ -0,0 +1,79 @@
+#ifndef LIBFIND_H
+#define LIBFIND_H
+
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Traversal of a directory tree for programs linking lib/libfind.a, entries
+// for which the expression is true are either pulled one at a time with
+// find_next or pushed to a callback by find_walk. Without a callback,
+// find_walk prints them the way the find command (which is built on it)
+// does. Entries carry their name, path and type, stat data is only fetched
+// when asked for with find_entry_stat.
+
+struct find_ctx;
+struct find_entry;
+
+// how find_walk prints entries when it is given no callback
+enum find_format
+{
+  FIND_FORMAT_TEXT,    // paths
+  FIND_FORMAT_NDJSON,  // one JSON object per line
+  FIND_FORMAT_BINARY   // length-prefixed records in host byte order
+};
+
+struct find_options
+{
+  int follow;     // follow symbolic links
+  int xdev;       // do not cross file system boundaries
+
+  int min_depth;  // the expression is not applied above this depth
+  int max_depth;  // directories at this depth are not read, -1 for no limit
+
+  int n_threads;  // threads used by find_walk, find_next walks sequentially
+
+  int inode_order;  // stat the entries of each directory in inode order first
+  int uring;        // stat the entries of each directory through io_uring
+
+  // expression tokens as given to the find command, terminated by NULL, or
+  // NULL to report every entry, the tokens have to outlive the traversal
+  char **expr;
+
+  // the rest only applies to find_walk without a callback, which prints to
+  // standard output
+  int ordered;    // print in sequential order even if n_threads > 1
+  int print0;     // terminate entries by NUL instead of newline
+  enum find_format format;    // not with -printf in the expression
+
+  int dupes;      // print groups of identical files instead (not with watch)
+  int du;         // print the usage of every directory after the entries
+  int watch;      // keep printing matching entries as they appear afterwards
+  int stats;      // print counts and times to standard error afterwards
+};
+
+void find_set_name (char const *name);
+
+void find_options_init (struct find_options *opts);
+
+struct find_ctx *find_open (char const *root, struct find_options const *opts);
+int find_next (struct find_ctx *ctx, struct find_entry **e);
+void find_prune (struct find_ctx *ctx);
+int find_close (struct find_ctx *ctx);
+
+int find_walk (char const *root, struct find_options const *opts,
+               int (*fn) (struct find_entry *e, void *arg), void *arg);
+
+char const *find_entry_name (struct find_entry const *e);
+char const *find_entry_path (struct find_entry const *e);
+unsigned char find_entry_type (struct find_entry const *e);
+int find_entry_stat (struct find_entry *e, struct stat *sb);
+void find_entry_prune (struct find_entry *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBFIND_H */
@@ -0,0 +1,42 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -name pattern compiled into the cheapest matcher that implements it
+enum match_kind
+{
+  MATCH_ANY,       // *
+  MATCH_LITERAL,   // abc
+  MATCH_PREFIX,    // abc*
+  MATCH_SUFFIX,    // *abc
+  MATCH_CONTAINS,  // *abc*
+  MATCH_DFA,       // everything else
+  MATCH_FNMATCH    // patterns the DFA compiler does not support
+};
+
+struct matcher
+{
+  enum match_kind kind;
+
+  // MATCH_LITERAL, MATCH_PREFIX, MATCH_SUFFIX, MATCH_CONTAINS
+  char *lit;
+  size_t lit_len;
+
+  // MATCH_DFA, state 0 is the dead state
+  int n_states;
+  int start;
+  uint16_t *trans;        // n_states * 256 transitions
+  unsigned char *accept;  // n_states flags
+
+  // MATCH_FNMATCH
+  char *pattern;
+};
+
+int matcher_compile (struct matcher *m, char const *pattern);
+void matcher_free (struct matcher *m);
+
+int matcher_match (struct matcher const *m, char const *name);
+
+#endif /* MATCH_H */
@@ -0,0 +1,32 @@
+#ifndef MULTIMATCH_H
+#define MULTIMATCH_H
+
+#include <stdint.h>
+
+#include "match.h"
+
+// Set of -name patterns matched in a single pass. Patterns that compile to
+// literal, prefix, suffix or infix matchers are merged into one Aho-Corasick
+// automaton over the name enclosed in begin/end anchors, all other patterns
+// are kept as individual matchers.
+struct multi_matcher
+{
+  int any;  // some pattern is '*'
+
+  // Aho-Corasick automaton with completed transitions, state 0 is the root
+  unsigned char cls[256];  // byte to character class
+  int n_classes;
+  int n_states;
+  uint32_t *trans;         // n_states * n_classes transitions
+  unsigned char *accept;   // n_states flags
+
+  struct matcher *rest;
+  int n_rest;
+};
+
+int multi_matcher_load (struct multi_matcher *mm, char const *file);
+void multi_matcher_free (struct multi_matcher *mm);
+
+int multi_matcher_match (struct multi_matcher const *mm, char const *name);
+
+#endif /* MULTIMATCH_H */
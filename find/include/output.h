@@ -0,0 +1,35 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+#include "entry.h"
+
+struct format;
+
+#define OUT_BUF_SZ (64 * 1024)
+
+// buffer collecting output which is written out in large blocks, several
+// buffers may write to the same fd concurrently, flushes are serialized
+struct out_buf
+{
+  int fd;
+  char term;  // terminator written after each path
+
+  char *buf;
+  size_t len;
+};
+
+int out_init (struct out_buf *ob, int fd, char term);
+int out_free (struct out_buf *ob);
+
+int out_flush (struct out_buf *ob);
+int out_write (struct out_buf *ob, char const *data, size_t len);
+int out_path (struct out_buf *ob, char const *path, size_t len);
+int out_entry (struct out_buf *ob, struct format const *f,
+               struct entry const *e, size_t path_len);
+
+void out_bind (struct out_buf *ob, struct format const *f);
+int out_sync (struct entry *e);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,25 @@
+#ifndef PATHBUF_H
+#define PATHBUF_H
+
+#include <stddef.h>
+
+// growable buffer holding the path of the entry currently being visited,
+// names are appended when descending and cut off again when returning
+struct path_buf
+{
+  char *buf;
+  size_t len, cap;
+};
+
+int path_buf_init (struct path_buf *pb);
+void path_buf_free (struct path_buf *pb);
+
+int path_buf_set (struct path_buf *pb, char const *path);
+int path_buf_push (struct path_buf *pb, char const *name);
+int path_buf_append (struct path_buf *pb, char const *data, size_t len);
+void path_buf_truncate (struct path_buf *pb, size_t len);
+
+int path_cmp (char const *a, char const *b);
+int path_below (char const *path, char const *dir, size_t len);
+
+#endif /* PATHBUF_H */
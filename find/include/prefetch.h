@@ -0,0 +1,78 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "dirread.h"
+#include "uring.h"
+#include "xstat.h"
+
+struct find_opts;
+
+struct prefetch_entry
+{
+  size_t name;          // offset of the name in the name buffer
+  ino_t ino;
+  unsigned char type;   // DT_* type reported by the directory listing
+  long stat;            // index of the entry's stat data, -1 if it has none
+};
+
+// stat data fetched for an entry ahead of visiting it
+struct prefetch_stat
+{
+  int ok;  // the call succeeded
+  struct linux_statx stx;
+};
+
+// entries of a directory read in full, with the stat data of those that are
+// going to need it, in directory order
+struct prefetch_list
+{
+  struct prefetch_entry *ents;
+  size_t n_ents, cap_ents;
+
+  char *names;
+  size_t len, cap;
+
+  struct prefetch_stat *stats;  // in the order the calls were made
+  size_t cap_stats;
+
+  size_t pos;  // entry returned next by prefetch_next
+};
+
+// entry to be stat'ed, sorted by inode number with -inode-order
+struct prefetch_key
+{
+  ino_t ino;
+  size_t ent;
+};
+
+// scratch space for reading and stat'ing directories, reused across
+// directories
+struct prefetch
+{
+  struct dir_reader dr;
+  int have_dr;
+
+  struct prefetch_key *keys;
+  struct uring_req *reqs;  // calls to be made, in order
+  size_t cap_keys;
+
+  // -uring only
+  struct uring ring;
+  int ring_state;  // 0 if not set up yet, 1 if usable, -1 if not
+};
+
+void prefetch_init (struct prefetch *pf);
+void prefetch_free (struct prefetch *pf);
+
+void prefetch_list_init (struct prefetch_list *list);
+void prefetch_list_free (struct prefetch_list *list);
+
+int prefetch_dir (struct prefetch *pf, struct prefetch_list *list,
+                  struct find_opts const *opts, int fd);
+int prefetch_next (struct prefetch_list *list, struct dir_entry *entry,
+                   struct linux_statx const **stx);
+
+#endif /* PREFETCH_H */
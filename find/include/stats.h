@@ -0,0 +1,40 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// phases whose time is measured with -stats
+enum stats_phase
+{
+  PHASE_READDIR,  // getdents calls
+  PHASE_OPEN,     // opening directories
+  PHASE_STAT,     // stat calls
+  PHASE_MATCH,    // evaluating the expression, without stat calls
+  PHASE_OUTPUT,   // writing output
+  N_PHASES
+};
+
+// counters kept per thread, merged into the totals when a thread is done
+struct find_stats
+{
+  unsigned long dirs;            // directories read
+  unsigned long entries;         // entries visited
+  unsigned long stat_calls;      // statx calls for visited entries
+  unsigned long open_calls;      // directories opened
+  unsigned long getdents_calls;
+  unsigned long loop_checks;
+  unsigned long max_active;      // largest set of directories checked against
+
+  uint64_t ns[N_PHASES];         // nanoseconds spent per phase
+};
+
+extern __thread struct find_stats thread_stats;
+
+uint64_t stats_clock (void);
+void stats_add_time (enum stats_phase phase, uint64_t start);
+
+void stats_start (void);
+void stats_merge (void);
+void stats_report (void);
+
+#endif /* STATS_H */
@@ -0,0 +1,45 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+
+#include "xstat.h"
+
+#define URING_ENTRIES 128  // requests kept in flight at most
+
+struct linux_io_uring_sqe;
+struct linux_io_uring_cqe;
+
+// io_uring instance used to issue batches of statx requests
+struct uring
+{
+  int fd;
+  unsigned entries;
+
+  // submission queue
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  struct linux_io_uring_sqe *sqes;
+
+  // completion queue
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct linux_io_uring_cqe *cqes;
+
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+};
+
+// statx request for name, the result is written to stx
+struct uring_req
+{
+  char const *name;
+  struct linux_statx *stx;
+  int res;  // 0 or a negative errno value, -ECANCELED if not carried out
+};
+
+int uring_init (struct uring *ring);
+void uring_free (struct uring *ring);
+
+int uring_statx (struct uring *ring, int dirfd, struct uring_req *reqs,
+                 size_t n, int flags, unsigned mask);
+
+#endif /* URING_H */
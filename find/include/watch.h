@@ -0,0 +1,34 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <pthread.h>
+
+struct find_opts;
+
+struct watch_dir
+{
+  char *path;
+  int depth;
+};
+
+// inotify instance watching every directory of the tree, directories are
+// added while they are traversed (possibly by several threads)
+struct watcher
+{
+  int fd;
+
+  pthread_mutex_t lock;
+  struct watch_dir *dirs;  // watched directories, indexed by descriptor
+  int n_dirs;
+  int n_watched;           // number of directories currently watched
+
+  int full;      // the watch limit has been reached
+};
+
+int watch_init (struct watcher *w);
+void watch_free (struct watcher *w);
+
+int watch_add (struct watcher *w, char const *path, int depth);
+int watch_run (struct find_opts const *opts, struct watcher *w);
+
+#endif /* WATCH_H */
@@ -0,0 +1,55 @@
+#ifndef XSTAT_H
+#define XSTAT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// statx field mask bits, see statx(2)
+#define STATX_TYPE   0x0001U
+#define STATX_MODE   0x0002U
+#define STATX_NLINK  0x0004U
+#define STATX_UID    0x0008U
+#define STATX_GID    0x0010U
+#define STATX_ATIME  0x0020U
+#define STATX_MTIME  0x0040U
+#define STATX_CTIME  0x0080U
+#define STATX_INO    0x0100U
+#define STATX_SIZE   0x0200U
+#define STATX_BLOCKS 0x0400U
+#define STATX_BASIC_STATS 0x07ffU  // all of the above, what struct stat has
+
+struct linux_statx_timestamp
+{
+  int64_t tv_sec;
+  uint32_t tv_nsec;
+  int32_t reserved;
+};
+
+// record layout filled in by statx, only the fields named in stx_mask (and
+// the device) are valid
+struct linux_statx
+{
+  uint32_t stx_mask;
+  uint32_t stx_blksize;
+  uint64_t stx_attributes;
+  uint32_t stx_nlink;
+  uint32_t stx_uid;
+  uint32_t stx_gid;
+  uint16_t stx_mode;
+  uint16_t spare0;
+  uint64_t stx_ino;
+  uint64_t stx_size;
+  uint64_t stx_blocks;
+  uint64_t stx_attributes_mask;
+  struct linux_statx_timestamp stx_atime, stx_btime, stx_ctime, stx_mtime;
+  uint32_t stx_rdev_major, stx_rdev_minor;
+  uint32_t stx_dev_major, stx_dev_minor;
+  uint64_t spare[14];
+};
+
+int xstatat (int dirfd, char const *name, int flags, unsigned mask,
+             struct linux_statx *stx);
+
+dev_t xstat_dev (struct linux_statx const *stx);
+
+#endif /* XSTAT_H */
@@ -0,0 +1,115 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "dirread.h"
+#include "find.h"
+#include "stats.h"
+
+// record layout returned by getdents64
+struct linux_dirent64
+{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+int
+dir_reader_init (struct dir_reader *dr)
+{
+  dr->fd = -1;
+  dr->len = dr->pos = 0;
+  dr->off = 0;
+
+  dr->buf = malloc (DIR_BUF_SZ);
+  if (!dr->buf)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  return 0;
+}
+
+void
+dir_reader_free (struct dir_reader *dr)
+{
+  free (dr->buf);
+}
+
+void
+dir_reader_reset (struct dir_reader *dr, int fd)
+{
+  dr->fd = fd;
+  dr->len = dr->pos = 0;
+  dr->off = 0;
+}
+
+// Continue reading fd at offset off, as previously reported in dr->off by a
+// reader of the same directory.
+int
+dir_reader_seek (struct dir_reader *dr, int fd, off_t off)
+{
+  if (lseek (fd, off, SEEK_SET) == -1)
+    return -1;
+
+  dir_reader_reset (dr, fd);
+  dr->off = off;
+
+  return 0;
+}
+
+// Store the next entry (skipping . and ..) in *entry. Returns 1 if an entry
+// was read, 0 at the end of the directory and -1 on errors. entry->name is
+// only valid until the next call.
+int
+dir_read (struct dir_reader *dr, struct dir_entry *entry)
+{
+  for (;;)
+    {
+      if (dr->pos >= dr->len)
+        {
+          uint64_t start = stats_clock ();
+
+          long n = syscall (SYS_getdents64, dr->fd, dr->buf, DIR_BUF_SZ);
+
+          stats_add_time (PHASE_READDIR, start);
+          ++thread_stats.getdents_calls;
+          if (n == -1)
+            {
+              fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+              return -1;
+            }
+
+          if (n == 0)
+            return 0;
+
+          dr->len = n;
+          dr->pos = 0;
+        }
+
+      struct linux_dirent64 *d = (struct linux_dirent64 *) (dr->buf + dr->pos);
+      dr->pos += d->d_reclen;
+      dr->off = d->d_off;
+
+      // ignore . and ..
+      if (d->d_name[0] == '.'
+          && (d->d_name[1] == '\0'
+              || (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+        {
+          continue;
+        }
+
+      entry->name = d->d_name;
+      entry->type = d->d_type;
+      entry->ino = d->d_ino;
+
+      return 1;
+    }
+}
@@ -0,0 +1,212 @@
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "du.h"
+#include "find.h"
+#include "output.h"
+#include "pathbuf.h"
+
+// Every directory is charged with the usage of the entries read from it by
+// whichever thread reads it, the directory's own usage is charged to the
+// directory itself. Each directory is recorded once it has been read, the
+// totals of whole subtrees are only added up after the traversal, by
+// sorting the directories into pre-order and rolling each one up into its
+// parent. Files with several links are counted once.
+
+struct du_dir
+{
+  char *path;
+  int depth;
+  struct du_sum sum;
+};
+
+int
+du_init (struct du *du, int max_depth)
+{
+  if (ino_set_init (&du->links) != 0)
+    return -1;
+
+  pthread_mutex_init (&du->lock, NULL);
+
+  du->dirs = NULL;
+  du->n_dirs = du->cap = 0;
+  du->max_depth = max_depth;
+
+  return 0;
+}
+
+void
+du_free (struct du *du)
+{
+  for (size_t i = 0; i < du->n_dirs; ++i)
+    free (du->dirs[i].path);
+
+  free (du->dirs);
+  ino_set_free (&du->links);
+
+  pthread_mutex_destroy (&du->lock);
+}
+
+// Store the usage of the entry in *usage, which is zero if it is a further
+// link to a file counted already (with -follow, files and directories
+// reached through symlinks are counted once as well). Returns -1 on errors.
+int
+du_usage (struct du *du, struct entry *e, struct du_sum *usage)
+{
+  usage->apparent = usage->allocated = 0;
+
+  if (entry_stat (e, STATX_SIZE | STATX_BLOCKS | STATX_NLINK | STATX_INO)
+      != 0)
+    {
+      return 0;
+    }
+
+  if (e->follow || (e->type != DT_DIR && e->stx.stx_nlink > 1))
+    {
+      pthread_mutex_lock (&du->lock);
+      int ret = ino_set_insert (&du->links, xstat_dev (&e->stx),
+                                e->stx.stx_ino);
+      pthread_mutex_unlock (&du->lock);
+
+      if (ret != 1)
+        return ret;
+    }
+
+  usage->apparent = e->stx.stx_size;
+  usage->allocated = e->stx.stx_blocks * 512;
+
+  return 0;
+}
+
+// record the directory at path together with the usage of its entries
+int
+du_add_dir (struct du *du, char const *path, int depth,
+            struct du_sum const *sum)
+{
+  char *copy = malloc (strlen (path) + 1);
+  if (!copy)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  strcpy (copy, path);
+
+  pthread_mutex_lock (&du->lock);
+
+  if (du->n_dirs == du->cap)
+    {
+      size_t n = du->cap ? 2 * du->cap : 256;
+
+      struct du_dir *tmp = realloc (du->dirs, n * sizeof (*tmp));
+      if (!tmp)
+        {
+          pthread_mutex_unlock (&du->lock);
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          free (copy);
+          return -1;
+        }
+
+      du->dirs = tmp;
+      du->cap = n;
+    }
+
+  struct du_dir *d = &du->dirs[du->n_dirs++];
+
+  d->path = copy;
+  d->depth = depth;
+  d->sum = *sum;
+
+  pthread_mutex_unlock (&du->lock);
+
+  return 0;
+}
+
+// === Report ==================================================================
+
+static int
+cmp_dirs (void const *a, void const *b)
+{
+  return path_cmp (((struct du_dir const *) a)->path,
+                   ((struct du_dir const *) b)->path);
+}
+
+static int
+print_dir (struct du const *du, struct out_buf *out, struct du_dir const *d)
+{
+  if (d->depth > du->max_depth)
+    return 0;
+
+  char sizes[48];
+  int n = snprintf (sizes, sizeof (sizes), "%llu\t%llu\t",
+                    (unsigned long long) d->sum.apparent,
+                    (unsigned long long) d->sum.allocated);
+
+  if (out_write (out, sizes, n) != 0)
+    return -1;
+
+  return out_path (out, d->path, strlen (d->path));
+}
+
+// Write the apparent and allocated size of every directory (including
+// everything below it) followed by its path to fd, subdirectories before
+// the directory containing them.
+int
+du_report (struct du *du, int fd, char term)
+{
+  qsort (du->dirs, du->n_dirs, sizeof (*du->dirs), cmp_dirs);
+
+  // the directories on the path to the current one, each is complete (and
+  // is added to its parent) once a directory outside of it comes up
+  struct du_dir **stack = malloc ((du->n_dirs + 1) * sizeof (*stack));
+  if (!stack)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  struct out_buf out;
+  if (out_init (&out, fd, term) != 0)
+    {
+      free (stack);
+      return -1;
+    }
+
+  int n = 0;
+  int err = 0;
+
+  for (size_t i = 0; i <= du->n_dirs && !err; ++i)
+    {
+      struct du_dir *d = i < du->n_dirs ? &du->dirs[i] : NULL;
+
+      while (n > 0 && !err
+             && (!d || !path_below (d->path, stack[n - 1]->path,
+                                    strlen (stack[n - 1]->path))))
+        {
+          struct du_dir *done = stack[--n];
+
+          if (n > 0)
+            {
+              stack[n - 1]->sum.apparent += done->sum.apparent;
+              stack[n - 1]->sum.allocated += done->sum.allocated;
+            }
+
+          err = print_dir (du, &out, done);
+        }
+
+      if (d)
+        stack[n++] = d;
+    }
+
+  if (out_free (&out) != 0)
+    err = -1;
+
+  free (stack);
+
+  return err;
+}
@@ -0,0 +1,484 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dupes.h"
+#include "find.h"
+#include "output.h"
+
+// Files are collected together with their size while the tree is traversed,
+// every (dev, ino) only once so that hard links are never reported as
+// duplicates of each other. Afterwards files are grouped by size and only
+// groups with more than one member are looked at: first the head and tail
+// of each file are hashed, then candidates which still share size and hash
+// are hashed in full (files small enough to be covered by head and tail
+// entirely are done after the first step). Hashing is spread over a pool of
+// threads which take files one at a time, large files are read in windows
+// of DUPES_WINDOW bytes. Files are read rather than mapped since they may
+// have been truncated since they were visited, touching a mapping past the
+// end of the file would raise SIGBUS.
+
+#define DUPES_EDGE 4096  // bytes hashed at either end in the first step
+#define DUPES_WINDOW (4 * 1024 * 1024)
+
+struct dupe_file
+{
+  char *path;
+  uint64_t size;
+
+  uint64_t hash[2];
+  int full;     // hash covers the whole content
+  int failed;   // file could not be read
+};
+
+int
+dupes_init (struct dupes *d, int n_threads)
+{
+  if (ino_set_init (&d->seen) != 0)
+    return -1;
+
+  pthread_mutex_init (&d->lock, NULL);
+
+  d->files = NULL;
+  d->n_files = d->cap = 0;
+  d->n_threads = n_threads;
+
+  return 0;
+}
+
+void
+dupes_free (struct dupes *d)
+{
+  for (size_t i = 0; i < d->n_files; ++i)
+    free (d->files[i].path);
+
+  free (d->files);
+  ino_set_free (&d->seen);
+
+  pthread_mutex_destroy (&d->lock);
+}
+
+// Collect the regular file at path, further links to the same file are
+// ignored. Returns -1 on errors.
+int
+dupes_add (struct dupes *d, char const *path, uint64_t size, dev_t dev,
+           ino_t ino)
+{
+  pthread_mutex_lock (&d->lock);
+
+  int ret = ino_set_insert (&d->seen, dev, ino);
+  if (ret != 1)
+    {
+      pthread_mutex_unlock (&d->lock);
+      return ret;
+    }
+
+  if (d->n_files == d->cap)
+    {
+      size_t n = d->cap ? 2 * d->cap : 1024;
+
+      struct dupe_file *tmp = realloc (d->files, n * sizeof (*tmp));
+      if (!tmp)
+        {
+          pthread_mutex_unlock (&d->lock);
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      d->files = tmp;
+      d->cap = n;
+    }
+
+  struct dupe_file *f = &d->files[d->n_files];
+
+  f->path = malloc (strlen (path) + 1);
+  if (!f->path)
+    {
+      pthread_mutex_unlock (&d->lock);
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  strcpy (f->path, path);
+  f->size = size;
+  f->full = f->failed = 0;
+
+  ++d->n_files;
+
+  pthread_mutex_unlock (&d->lock);
+
+  return 0;
+}
+
+// === Hashing =================================================================
+
+// 128-bit hash over four 64-bit lanes (the round function of xxHash64), the
+// input is consumed in blocks of 32 bytes, only the last part of the
+// content may be shorter
+
+#define PRIME1 0x9e3779b185ebca87ULL
+#define PRIME2 0xc2b2ae3d27d4eb4fULL
+
+struct hasher
+{
+  uint64_t v[4];
+  uint64_t len;
+};
+
+static uint64_t
+rotl (uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t
+fmix (uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+static void
+hash_init (struct hasher *h)
+{
+  h->v[0] = PRIME1 + PRIME2;
+  h->v[1] = PRIME2;
+  h->v[2] = 0;
+  h->v[3] = -PRIME1;
+  h->len = 0;
+}
+
+static void
+hash_update (struct hasher *h, unsigned char const *buf, size_t n)
+{
+  h->len += n;
+
+  for (size_t i = 0; i < n; i += 8)
+    {
+      uint64_t w = 0;
+      memcpy (&w, buf + i, n - i < 8 ? n - i : 8);
+
+      uint64_t *v = &h->v[(i / 8) % 4];
+
+      *v += w * PRIME2;
+      *v = rotl (*v, 31) * PRIME1;
+    }
+}
+
+static void
+hash_final (struct hasher const *h, uint64_t out[2])
+{
+  uint64_t const *v = h->v;
+
+  out[0] = fmix ((rotl (v[0], 1) + rotl (v[1], 7) + rotl (v[2], 12)
+                  + rotl (v[3], 18)) ^ h->len);
+  out[1] = fmix ((v[0] * PRIME1) ^ (v[1] * PRIME2) ^ rotl (v[2] * PRIME1, 29)
+                 ^ rotl (v[3] * PRIME2, 47) ^ ~h->len);
+}
+
+static int
+read_at (int fd, unsigned char *buf, size_t n, off_t off)
+{
+  while (n > 0)
+    {
+      ssize_t r = pread (fd, buf, n, off);
+      if (r == -1 && errno == EINTR)
+        continue;
+
+      if (r <= 0)
+        {
+          // the file shrank since it was visited
+          if (r == 0)
+            errno = EIO;
+
+          return -1;
+        }
+
+      buf += r;
+      n -= r;
+      off += r;
+    }
+
+  return 0;
+}
+
+// hash the head and tail of f, or all of it if they cover the whole file
+static int
+hash_edges (struct dupe_file *f, int fd)
+{
+  unsigned char buf[2 * DUPES_EDGE];
+  struct hasher h;
+
+  hash_init (&h);
+
+  if (f->size <= sizeof (buf))
+    {
+      if (read_at (fd, buf, f->size, 0) != 0)
+        return -1;
+
+      hash_update (&h, buf, f->size);
+      f->full = 1;
+    }
+  else
+    {
+      if (read_at (fd, buf, DUPES_EDGE, 0) != 0
+          || read_at (fd, buf + DUPES_EDGE, DUPES_EDGE,
+                      f->size - DUPES_EDGE) != 0)
+        {
+          return -1;
+        }
+
+      hash_update (&h, buf, sizeof (buf));
+    }
+
+  hash_final (&h, f->hash);
+
+  return 0;
+}
+
+// hash all of f window by window through buf, which holds DUPES_WINDOW bytes
+static int
+hash_content (struct dupe_file *f, int fd, unsigned char *buf)
+{
+  // the content no longer is what was collected
+  struct stat sb;
+  if (fstat (fd, &sb) == -1)
+    return -1;
+
+  if ((uint64_t) sb.st_size != f->size)
+    {
+      errno = EIO;
+      return -1;
+    }
+
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  struct hasher h;
+  hash_init (&h);
+
+  for (uint64_t off = 0; off < f->size; off += DUPES_WINDOW)
+    {
+      size_t n = f->size - off < DUPES_WINDOW ? f->size - off : DUPES_WINDOW;
+
+      if (read_at (fd, buf, n, off) != 0)
+        return -1;
+
+      hash_update (&h, buf, n);
+    }
+
+  hash_final (&h, f->hash);
+  f->full = 1;
+
+  return 0;
+}
+
+struct hash_job
+{
+  struct dupe_file **files;
+  size_t n_files;
+  size_t next;  // next file to hash, taken atomically
+  int full;     // hash the whole content rather than head and tail
+};
+
+static void *
+hash_worker (void *arg)
+{
+  struct hash_job *job = arg;
+
+  // window full hashes are read through, files cannot be hashed without it
+  unsigned char *buf = job->full ? malloc (DUPES_WINDOW) : NULL;
+
+  for (;;)
+    {
+      size_t i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED);
+      if (i >= job->n_files)
+        break;
+
+      struct dupe_file *f = job->files[i];
+      if (job->full && f->full)
+        continue;
+
+      if (job->full && !buf)
+        {
+          fprintf (stderr, "%s: %s: %s\n", prog_name, f->path,
+                   strerror (ENOMEM));
+          f->failed = 1;
+          continue;
+        }
+
+      int fd = open (f->path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+      if (fd == -1)
+        {
+          fprintf (stderr, "%s: %s: %s\n", prog_name, f->path,
+                   strerror (errno));
+          f->failed = 1;
+          continue;
+        }
+
+      int err = job->full ? hash_content (f, fd, buf) : hash_edges (f, fd);
+
+      if (err != 0)
+        {
+          fprintf (stderr, "%s: %s: %s\n", prog_name, f->path,
+                   strerror (errno));
+          f->failed = 1;
+        }
+
+      close (fd);
+    }
+
+  free (buf);
+
+  return NULL;
+}
+
+// hash the n files (in full or head and tail only) on up to n_threads
+// threads
+static void
+hash_files (struct dupe_file **files, size_t n, int full, int n_threads)
+{
+  struct hash_job job = { files, n, 0, full };
+
+  pthread_t tids[n_threads];
+  int n_started = 0;
+
+  // the calling thread is one of the workers
+  for (; n_started < n_threads - 1 && (size_t) n_started + 1 < n;
+       ++n_started)
+    {
+      if (pthread_create (&tids[n_started], NULL, hash_worker, &job) != 0)
+        break;
+    }
+
+  hash_worker (&job);
+
+  for (int i = 0; i < n_started; ++i)
+    pthread_join (tids[i], NULL);
+}
+
+// === Grouping ================================================================
+
+static int
+cmp_files (void const *a, void const *b)
+{
+  struct dupe_file const *f = *(struct dupe_file * const *) a;
+  struct dupe_file const *g = *(struct dupe_file * const *) b;
+
+  if (f->size != g->size)
+    return f->size < g->size ? -1 : 1;
+
+  for (int i = 0; i < 2; ++i)
+    {
+      if (f->hash[i] != g->hash[i])
+        return f->hash[i] < g->hash[i] ? -1 : 1;
+    }
+
+  return strcmp (f->path, g->path);
+}
+
+static int
+same_group (struct dupe_file const *f, struct dupe_file const *g)
+{
+  return f->size == g->size && f->hash[0] == g->hash[0]
+         && f->hash[1] == g->hash[1];
+}
+
+// Sort the n files by size and hash and keep only those that are readable
+// and share both with another file. Returns the number of files kept.
+static size_t
+keep_groups (struct dupe_file **files, size_t n)
+{
+  qsort (files, n, sizeof (*files), cmp_files);
+
+  size_t kept = 0;
+
+  for (size_t i = 0; i < n; )
+    {
+      size_t j = i + 1;
+      while (j < n && same_group (files[i], files[j]))
+        ++j;
+
+      // groups only shrink, so readable members are moved forward in place
+      size_t first = kept;
+      for (size_t k = i; k < j; ++k)
+        {
+          if (!files[k]->failed)
+            files[kept++] = files[k];
+        }
+
+      if (kept - first < 2)
+        kept = first;
+
+      i = j;
+    }
+
+  return kept;
+}
+
+// Find the duplicates among the collected files and write them to fd as
+// groups of paths separated by an empty line, each path followed by term.
+int
+dupes_report (struct dupes *d, int fd, char term)
+{
+  struct dupe_file **files = malloc ((d->n_files + 1) * sizeof (*files));
+  if (!files)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  // empty files are all the same and not worth reporting
+  size_t n = 0;
+  for (size_t i = 0; i < d->n_files; ++i)
+    {
+      if (d->files[i].size > 0)
+        {
+          d->files[i].hash[0] = d->files[i].hash[1] = 0;
+          files[n++] = &d->files[i];
+        }
+    }
+
+  n = keep_groups (files, n);
+
+  hash_files (files, n, 0, d->n_threads);
+  n = keep_groups (files, n);
+
+  hash_files (files, n, 1, d->n_threads);
+  n = keep_groups (files, n);
+
+  struct out_buf out;
+  if (out_init (&out, fd, term) != 0)
+    {
+      free (files);
+      return -1;
+    }
+
+  int err = 0;
+
+  for (size_t i = 0; i < n && !err; ++i)
+    {
+      if (i > 0 && !same_group (files[i - 1], files[i]))
+        err = out_write (&out, &term, 1);
+
+      if (!err)
+        err = out_path (&out, files[i]->path, strlen (files[i]->path));
+    }
+
+  if (out_free (&out) != 0)
+    err = -1;
+
+  free (files);
+
+  return err;
+}
@@ -0,0 +1,449 @@
+#include <errno.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "exec.h"
+#include "find.h"
+#include "output.h"
+
+// Commands are started with posix_spawn, at most max_procs of them run at
+// once. Single commands (-exec ... ;) are waited for right away by the thread
+// that started them, batches (-exec ... {} +) keep running while the
+// traversal goes on and are reaped oldest first by whoever needs a free slot.
+// Whatever the traversal has printed so far is written out before a command
+// is started, so that it precedes the command's output.
+
+// bytes kept free in the argument space, as xargs does
+#define ARG_HEADROOM 2048
+
+extern char **environ;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+static int max_procs = 1;
+static int n_running;
+
+// running batches in the order they were started
+static pid_t *batches;
+static int n_batches, cap_batches;
+static int batch_failed;
+
+// bytes available for arguments, 0 until computed
+static size_t arg_space;
+
+// === Process pool ============================================================
+
+// set the number of commands that may run at once (-P)
+void
+exec_set_procs (int n)
+{
+  max_procs = n;
+}
+
+// returns 0 if the child exited successfully
+static int
+reap (pid_t pid)
+{
+  int status;
+
+  while (waitpid (pid, &status, 0) == -1)
+    {
+      if (errno != EINTR)
+        return -1;
+    }
+
+  return WIFEXITED (status) && WEXITSTATUS (status) == 0 ? 0 : -1;
+}
+
+// reap the oldest batch, called (and returning) with pool_lock held
+static void
+reap_batch (void)
+{
+  pid_t pid = batches[0];
+  memmove (batches, batches + 1, --n_batches * sizeof (*batches));
+
+  pthread_mutex_unlock (&pool_lock);
+  int err = reap (pid);
+  pthread_mutex_lock (&pool_lock);
+
+  if (err != 0)
+    batch_failed = 1;
+
+  --n_running;
+  pthread_cond_broadcast (&pool_cond);
+}
+
+static void
+acquire_slot (void)
+{
+  pthread_mutex_lock (&pool_lock);
+
+  while (n_running >= max_procs)
+    {
+      if (n_batches > 0)
+        reap_batch ();
+      else
+        pthread_cond_wait (&pool_cond, &pool_lock);
+    }
+
+  ++n_running;
+
+  pthread_mutex_unlock (&pool_lock);
+}
+
+static void
+batch_error (void)
+{
+  pthread_mutex_lock (&pool_lock);
+  batch_failed = 1;
+  pthread_mutex_unlock (&pool_lock);
+}
+
+static void
+release_slot (void)
+{
+  pthread_mutex_lock (&pool_lock);
+
+  --n_running;
+  pthread_cond_broadcast (&pool_cond);
+
+  pthread_mutex_unlock (&pool_lock);
+}
+
+// Start argv in a free slot once the output printed so far (including e, the
+// entry being evaluated, if not NULL) is written out. Returns -1 (and
+// releases the slot) on errors.
+static pid_t
+spawn (char **argv, struct entry *e)
+{
+  if (out_sync (e) != 0)
+    return -1;
+
+  acquire_slot ();
+
+  pid_t pid;
+  int err = posix_spawnp (&pid, argv[0], NULL, NULL, argv, environ);
+  if (err != 0)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, argv[0], strerror (err));
+      release_slot ();
+      return -1;
+    }
+
+  return pid;
+}
+
+// Wait for all batches (and single commands) still running, returns -1 if
+// any batch failed.
+int
+exec_wait (void)
+{
+  pthread_mutex_lock (&pool_lock);
+
+  while (n_running > 0)
+    {
+      if (n_batches > 0)
+        reap_batch ();
+      else
+        pthread_cond_wait (&pool_cond, &pool_lock);
+    }
+
+  free (batches);
+  batches = NULL;
+  cap_batches = 0;
+
+  int err = batch_failed ? -1 : 0;
+
+  pthread_mutex_unlock (&pool_lock);
+
+  return err;
+}
+
+// === Commands ================================================================
+
+static size_t
+arg_size (char const *arg)
+{
+  return strlen (arg) + 1 + sizeof (char *);
+}
+
+// Set up the command given by the argc words in argv (without the
+// terminating ; or {} +).
+int
+exec_cmd_init (struct exec_cmd *cmd, char **argv, int argc, int batch)
+{
+  // the space taken by the environment is not available for arguments
+  if (arg_space == 0)
+    {
+      long max = sysconf (_SC_ARG_MAX);
+      size_t env = 0;
+
+      for (char **p = environ; *p; ++p)
+        env += arg_size (*p);
+
+      arg_space = (max > 0 ? (size_t) max : 128 * 1024) - env - ARG_HEADROOM;
+    }
+
+  cmd->argc = batch ? argc - 1 : argc;
+  cmd->batch = batch;
+
+  cmd->args = NULL;
+  cmd->n_args = cmd->cap = 0;
+  cmd->size = 0;
+
+  // the words themselves outlive the command, the array holding them not
+  cmd->argv = malloc (cmd->argc * sizeof (*cmd->argv));
+  if (!cmd->argv)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  memcpy (cmd->argv, argv, cmd->argc * sizeof (*cmd->argv));
+
+  if (batch)
+    {
+      cmd->cap = cmd->argc + 64;
+      cmd->args = malloc (cmd->cap * sizeof (*cmd->args));
+      if (!cmd->args)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          free (cmd->argv);
+          return -1;
+        }
+
+      for (int i = 0; i < cmd->argc; ++i)
+        {
+          cmd->args[cmd->n_args++] = argv[i];
+          cmd->size += arg_size (argv[i]);
+        }
+    }
+
+  pthread_mutex_init (&cmd->lock, NULL);
+
+  return 0;
+}
+
+void
+exec_cmd_free (struct exec_cmd *cmd)
+{
+  if (cmd->batch)
+    {
+      for (int i = cmd->argc; i < cmd->n_args; ++i)
+        free (cmd->args[i]);
+    }
+
+  free (cmd->args);
+  free (cmd->argv);
+
+  pthread_mutex_destroy (&cmd->lock);
+}
+
+// replace every {} in arg by path
+static char *
+substitute (char const *arg, char const *path)
+{
+  size_t n = 0;
+  for (char const *p = strstr (arg, "{}"); p; p = strstr (p + 2, "{}"))
+    ++n;
+
+  size_t path_len = strlen (path);
+
+  char *res = malloc (strlen (arg) + n * path_len + 1 - 2 * n);
+  if (!res)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  char *out = res;
+
+  for (char const *p; (p = strstr (arg, "{}")); arg = p + 2)
+    {
+      memcpy (out, arg, p - arg);
+      out += p - arg;
+
+      memcpy (out, path, path_len);
+      out += path_len;
+    }
+
+  strcpy (out, arg);
+
+  return res;
+}
+
+// run the command once for the path of e and wait for it
+static int
+run_single (struct exec_cmd *cmd, struct entry *e)
+{
+  char **argv = calloc (cmd->argc + 1, sizeof (*argv));
+  if (!argv)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return 0;
+    }
+
+  int ok = 0;
+
+  for (int i = 0; i < cmd->argc; ++i)
+    {
+      if (!(argv[i] = substitute (cmd->argv[i], e->path)))
+        goto cleanup;
+    }
+
+  pid_t pid = spawn (argv, e);
+  if (pid != -1)
+    {
+      ok = (reap (pid) == 0);
+      release_slot ();
+    }
+
+cleanup:
+  for (int i = 0; i < cmd->argc; ++i)
+    free (argv[i]);
+
+  free (argv);
+
+  return ok;
+}
+
+// start the pending batch, called with cmd->lock held, e is the entry being
+// evaluated (if any)
+static int
+start_batch (struct exec_cmd *cmd, struct entry *e)
+{
+  if (cmd->n_args == cmd->argc)
+    return 0;
+
+  cmd->args[cmd->n_args] = NULL;
+
+  pid_t pid = spawn (cmd->args, e);
+
+  for (int i = cmd->argc; i < cmd->n_args; ++i)
+    free (cmd->args[i]);
+
+  cmd->n_args = cmd->argc;
+  cmd->size = 0;
+
+  for (int i = 0; i < cmd->argc; ++i)
+    cmd->size += arg_size (cmd->argv[i]);
+
+  if (pid == -1)
+    {
+      batch_error ();
+      return -1;
+    }
+
+  pthread_mutex_lock (&pool_lock);
+
+  if (n_batches == cap_batches)
+    {
+      int n = cap_batches ? 2 * cap_batches : 16;
+
+      pid_t *tmp = realloc (batches, n * sizeof (*tmp));
+      if (!tmp)
+        {
+          // cannot keep track of the batch, wait for it right away
+          pthread_mutex_unlock (&pool_lock);
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+
+          int err = reap (pid);
+          release_slot ();
+
+          if (err != 0)
+            batch_error ();
+
+          return err;
+        }
+
+      batches = tmp;
+      cap_batches = n;
+    }
+
+  batches[n_batches++] = pid;
+
+  pthread_mutex_unlock (&pool_lock);
+
+  return 0;
+}
+
+// add the path of e to the pending batch, starting the batch first if the
+// path would not fit into the argument space anymore
+static int
+add_to_batch (struct exec_cmd *cmd, struct entry *e)
+{
+  char const *path = e->path;
+
+  size_t sz = arg_size (path);
+
+  char *copy = malloc (strlen (path) + 1);
+  if (!copy)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  strcpy (copy, path);
+
+  pthread_mutex_lock (&cmd->lock);
+
+  int err = 0;
+
+  if (cmd->size + sz > arg_space)
+    err = start_batch (cmd, e);
+
+  // one slot is kept for the terminating NULL
+  if (cmd->n_args + 1 == cmd->cap)
+    {
+      char **tmp = realloc (cmd->args, 2 * cmd->cap * sizeof (*tmp));
+      if (!tmp)
+        {
+          pthread_mutex_unlock (&cmd->lock);
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          free (copy);
+          return -1;
+        }
+
+      cmd->args = tmp;
+      cmd->cap *= 2;
+    }
+
+  cmd->args[cmd->n_args++] = copy;
+  cmd->size += sz;
+
+  pthread_mutex_unlock (&cmd->lock);
+
+  return err;
+}
+
+// Run the command for the path of e, returns whether it succeeded. Paths of
+// batches are only collected, which always succeeds.
+int
+exec_run (struct exec_cmd *cmd, struct entry *e)
+{
+  if (!cmd->batch)
+    return run_single (cmd, e);
+
+  if (add_to_batch (cmd, e) != 0)
+    batch_error ();
+
+  return 1;
+}
+
+// start whatever is left in the pending batch
+int
+exec_flush (struct exec_cmd *cmd)
+{
+  pthread_mutex_lock (&cmd->lock);
+  int err = start_batch (cmd, NULL);
+  pthread_mutex_unlock (&cmd->lock);
+
+  return err;
+}
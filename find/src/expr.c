@@ -0,0 +1,1006 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "expr.h"
+#include "find.h"
+
+// The expression is parsed into a tree, operands of chains of -and and -or
+// are reordered so that predicates which can be decided from the name and
+// the directory entry type run before those that need stat data (operands
+// are never moved across actions so this does not change the result), then
+// the tree is flattened into a sequence of tests with jump targets.
+
+// costs of predicates
+#define COST_CHEAP 1
+#define COST_PATTERNS 4
+#define COST_STAT 100
+#define COST_GREP 1000
+#define COST_EXEC 10000
+
+// === Parser ==================================================================
+
+static struct
+{
+  char const *name;
+  enum expr_op op;
+  int n_args;
+} const primaries[] =
+{
+  {"-name", EXPR_NAME, 1},
+  {"-name-from", EXPR_NAME_FROM, 1},
+  {"-type", EXPR_TYPE, 1},
+  {"-size", EXPR_SIZE, 1},
+  {"-mtime", EXPR_MTIME, 1},
+  {"-newer", EXPR_NEWER, 1},
+  {"-perm", EXPR_PERM, 1},
+  {"-user", EXPR_USER, 1},
+  {"-grep", EXPR_GREP, 1},
+  {"-prune", EXPR_PRUNE, 0},
+  {"-print", EXPR_PRINT, 0},
+  {"-printf", EXPR_PRINTF, 1},
+  {"-exec", EXPR_EXEC, -1}  // up to ; or {} +
+};
+
+#define N_PRIMARIES (sizeof (primaries) / sizeof (primaries[0]))
+
+struct parser
+{
+  int argc;
+  char **argv;
+  int pos;
+};
+
+static char const *
+peek (struct parser *p)
+{
+  return p->pos < p->argc ? p->argv[p->pos] : NULL;
+}
+
+static int
+is_op (char const *arg, char const *op)
+{
+  return arg && strcmp (arg, op) == 0;
+}
+
+// Returns the length of the command following -exec in the argc tokens of
+// argv (without the terminating ; or {} +) and whether it is a batch, -1 if
+// it is not terminated.
+static int
+exec_length (int argc, char **argv, int *batch)
+{
+  for (int i = 0; i < argc; ++i)
+    {
+      *batch = (i > 0 && is_op (argv[i], "+") && is_op (argv[i - 1], "{}"));
+
+      if (is_op (argv[i], ";") || *batch)
+        return i;
+    }
+
+  return -1;
+}
+
+// Returns the number of arguments following expression token arg (taken
+// from the argc tokens in argv that follow it) or -1 if arg is not part of
+// the expression language.
+int
+expr_arity (char const *arg, int argc, char **argv)
+{
+  if (is_op (arg, "(") || is_op (arg, ")") || is_op (arg, "!")
+      || is_op (arg, "-not") || is_op (arg, "-a") || is_op (arg, "-and")
+      || is_op (arg, "-o") || is_op (arg, "-or"))
+    {
+      return 0;
+    }
+
+  for (size_t i = 0; i < N_PRIMARIES; ++i)
+    {
+      if (strcmp (arg, primaries[i].name) != 0)
+        continue;
+
+      if (primaries[i].op == EXPR_EXEC)
+        {
+          // an unterminated command takes all remaining tokens
+          int batch;
+          int n = exec_length (argc, argv, &batch);
+
+          return n == -1 ? argc : n + 1;
+        }
+
+      return primaries[i].n_args;
+    }
+
+  return -1;
+}
+
+static struct expr *
+new_expr (enum expr_op op, struct expr *left, struct expr *right)
+{
+  struct expr *e = calloc (1, sizeof (*e));
+  if (!e)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  e->op = op;
+  e->left = left;
+  e->right = right;
+
+  return e;
+}
+
+static void
+free_tree (struct expr *e)
+{
+  if (!e)
+    return;
+
+  switch (e->op)
+    {
+    case EXPR_AND:
+    case EXPR_OR:
+    case EXPR_NOT:
+      free_tree (e->left);
+      free_tree (e->right);
+      break;
+    case EXPR_NAME:
+      matcher_free (&e->arg.name);
+      break;
+    case EXPR_NAME_FROM:
+      multi_matcher_free (&e->arg.names);
+      break;
+    case EXPR_GREP:
+      grep_free (&e->arg.grep);
+      break;
+    case EXPR_EXEC:
+      exec_cmd_free (e->arg.exec);
+      free (e->arg.exec);
+      break;
+    default:
+      break;
+    }
+
+  free (e);
+}
+
+// parse [+-]n[suffix], returns the suffix or NULL on errors
+static char const *
+parse_num (char const *arg, enum expr_cmp *cmp, unsigned long long *n)
+{
+  *cmp = CMP_EQ;
+
+  if (*arg == '+')
+    {
+      *cmp = CMP_GT;
+      ++arg;
+    }
+  else if (*arg == '-')
+    {
+      *cmp = CMP_LT;
+      ++arg;
+    }
+
+  if (*arg < '0' || *arg > '9')
+    return NULL;
+
+  char *end;
+
+  errno = 0;
+  *n = strtoull (arg, &end, 10);
+
+  if (errno != 0)
+    return NULL;
+
+  return end;
+}
+
+static int
+parse_arg (struct expr *e, char const *prim, char const *arg)
+{
+  switch (e->op)
+    {
+    case EXPR_NAME:
+      return matcher_compile (&e->arg.name, arg);
+    case EXPR_NAME_FROM:
+      return multi_matcher_load (&e->arg.names, arg);
+    case EXPR_TYPE:
+      {
+        static char const types[] = "fdlbcps";
+        static unsigned char const dtypes[] =
+          { DT_REG, DT_DIR, DT_LNK, DT_BLK, DT_CHR, DT_FIFO, DT_SOCK };
+
+        char const *t = arg[0] && !arg[1] ? strchr (types, arg[0]) : NULL;
+        if (!t)
+          {
+            fprintf (stderr, "%s: argument to 'type' should be one of "
+                             "'f', 'd', 'l', 'b', 'c', 'p' or 's'\n",
+                     prog_name);
+            return -1;
+          }
+
+        e->arg.type = dtypes[t - types];
+        return 0;
+      }
+    case EXPR_SIZE:
+      {
+        char const *suffix = parse_num (arg, &e->arg.num.cmp, &e->arg.num.n);
+
+        if (suffix && suffix[0] && !suffix[1])
+          {
+            switch (suffix[0])
+              {
+              case 'c': e->arg.num.unit = 1; break;
+              case 'w': e->arg.num.unit = 2; break;
+              case 'b': e->arg.num.unit = 512; break;
+              case 'k': e->arg.num.unit = 1024; break;
+              case 'M': e->arg.num.unit = 1024 * 1024; break;
+              case 'G': e->arg.num.unit = 1024 * 1024 * 1024; break;
+              default: suffix = NULL; break;
+              }
+          }
+        else if (suffix && !suffix[0])
+          e->arg.num.unit = 512;
+        else
+          suffix = NULL;
+
+        if (!suffix)
+          {
+            fprintf (stderr, "%s: invalid argument '%s' to '%s'\n",
+                     prog_name, arg, prim);
+            return -1;
+          }
+
+        return 0;
+      }
+    case EXPR_MTIME:
+      {
+        char const *suffix = parse_num (arg, &e->arg.num.cmp, &e->arg.num.n);
+        if (!suffix || *suffix)
+          {
+            fprintf (stderr, "%s: invalid argument '%s' to '%s'\n",
+                     prog_name, arg, prim);
+            return -1;
+          }
+
+        return 0;
+      }
+    case EXPR_NEWER:
+      {
+        struct stat sb;
+        if (stat (arg, &sb) == -1)
+          {
+            fprintf (stderr, "%s: %s: %s\n", prog_name, arg, strerror (errno));
+            return -1;
+          }
+
+        e->arg.newer = sb.st_mtim;
+        return 0;
+      }
+    case EXPR_PERM:
+      {
+        char const *mode = arg;
+
+        e->arg.perm.how = PERM_EXACT;
+
+        if (*mode == '-')
+          {
+            e->arg.perm.how = PERM_ALL;
+            ++mode;
+          }
+        else if (*mode == '/')
+          {
+            e->arg.perm.how = PERM_ANY;
+            ++mode;
+          }
+
+        char *end;
+        unsigned long m = strtoul (mode, &end, 8);
+
+        if (!*mode || *end || m > 07777)
+          {
+            fprintf (stderr, "%s: invalid mode '%s', only octal modes are "
+                             "supported\n", prog_name, arg);
+            return -1;
+          }
+
+        e->arg.perm.mode = m;
+        return 0;
+      }
+    case EXPR_USER:
+      {
+        struct passwd *pw = getpwnam (arg);
+        if (pw)
+          {
+            e->arg.uid = pw->pw_uid;
+            return 0;
+          }
+
+        char *end;
+        unsigned long uid = strtoul (arg, &end, 10);
+
+        if (!*arg || *end)
+          {
+            fprintf (stderr, "%s: '%s' is not the name of a known user\n",
+                     prog_name, arg);
+            return -1;
+          }
+
+        e->arg.uid = uid;
+        return 0;
+      }
+    case EXPR_GREP:
+      return grep_compile (&e->arg.grep, arg);
+    case EXPR_PRINTF:
+      e->arg.format = arg;
+      return 0;
+    default:
+      return -1;
+    }
+}
+
+// -exec <command> ;, -exec <command> {} +
+static struct expr *
+parse_exec (struct parser *p)
+{
+  char const *prim = p->argv[p->pos];
+  char **argv = p->argv + p->pos + 1;
+
+  int batch;
+  int n = exec_length (p->argc - p->pos - 1, argv, &batch);
+
+  if (n == -1 || n == batch)
+    {
+      fprintf (stderr, "%s: missing argument to '%s'\n", prog_name, prim);
+      return NULL;
+    }
+
+  struct expr *e = new_expr (EXPR_EXEC, NULL, NULL);
+  if (!e)
+    return NULL;
+
+  e->arg.exec = malloc (sizeof (*e->arg.exec));
+  if (!e->arg.exec)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      free (e);
+      return NULL;
+    }
+
+  if (exec_cmd_init (e->arg.exec, argv, n, batch) != 0)
+    {
+      free (e->arg.exec);
+      free (e);
+      return NULL;
+    }
+
+  p->pos += n + 2;
+  return e;
+}
+
+static struct expr *parse_or (struct parser *p);
+
+static struct expr *
+parse_primary (struct parser *p)
+{
+  char const *arg = peek (p);
+
+  if (!arg)
+    {
+      fprintf (stderr, "%s: expected an expression\n", prog_name);
+      return NULL;
+    }
+
+  if (is_op (arg, "("))
+    {
+      ++p->pos;
+
+      struct expr *e = parse_or (p);
+      if (!e)
+        return NULL;
+
+      if (!is_op (peek (p), ")"))
+        {
+          fprintf (stderr, "%s: missing ')'\n", prog_name);
+          free_tree (e);
+          return NULL;
+        }
+
+      ++p->pos;
+      return e;
+    }
+
+  if (is_op (arg, "!") || is_op (arg, "-not"))
+    {
+      ++p->pos;
+
+      struct expr *operand = parse_primary (p);
+      if (!operand)
+        return NULL;
+
+      struct expr *e = new_expr (EXPR_NOT, operand, NULL);
+      if (!e)
+        free_tree (operand);
+
+      return e;
+    }
+
+  for (size_t i = 0; i < N_PRIMARIES; ++i)
+    {
+      if (strcmp (arg, primaries[i].name) != 0)
+        continue;
+
+      if (primaries[i].op == EXPR_EXEC)
+        return parse_exec (p);
+
+      int n_args = primaries[i].n_args;
+
+      if (p->pos + n_args >= p->argc)
+        {
+          fprintf (stderr, "%s: missing argument to '%s'\n", prog_name, arg);
+          return NULL;
+        }
+
+      struct expr *e = new_expr (primaries[i].op, NULL, NULL);
+      if (!e)
+        return NULL;
+
+      if (n_args > 0 && parse_arg (e, arg, p->argv[p->pos + 1]) != 0)
+        {
+          free (e);
+          return NULL;
+        }
+
+      p->pos += 1 + n_args;
+      return e;
+    }
+
+  fprintf (stderr, "%s: unexpected '%s' in expression\n", prog_name, arg);
+  return NULL;
+}
+
+static struct expr *
+parse_and (struct parser *p)
+{
+  struct expr *left = parse_primary (p);
+  if (!left)
+    return NULL;
+
+  for (;;)
+    {
+      char const *arg = peek (p);
+
+      // juxtaposition means -and
+      if (!arg || is_op (arg, ")") || is_op (arg, "-o") || is_op (arg, "-or"))
+        return left;
+
+      if (is_op (arg, "-a") || is_op (arg, "-and"))
+        ++p->pos;
+
+      struct expr *right = parse_primary (p);
+      if (!right)
+        {
+          free_tree (left);
+          return NULL;
+        }
+
+      struct expr *e = new_expr (EXPR_AND, left, right);
+      if (!e)
+        {
+          free_tree (left);
+          free_tree (right);
+          return NULL;
+        }
+
+      left = e;
+    }
+}
+
+static struct expr *
+parse_or (struct parser *p)
+{
+  struct expr *left = parse_and (p);
+  if (!left)
+    return NULL;
+
+  while (is_op (peek (p), "-o") || is_op (peek (p), "-or"))
+    {
+      ++p->pos;
+
+      struct expr *right = parse_and (p);
+      if (!right)
+        {
+          free_tree (left);
+          return NULL;
+        }
+
+      struct expr *e = new_expr (EXPR_OR, left, right);
+      if (!e)
+        {
+          free_tree (left);
+          free_tree (right);
+          return NULL;
+        }
+
+      left = e;
+    }
+
+  return left;
+}
+
+// === Cost based ordering =====================================================
+
+static int
+count_operands (struct expr *e, enum expr_op op)
+{
+  if (e->op != op)
+    return 1;
+
+  return count_operands (e->left, op) + count_operands (e->right, op);
+}
+
+static void
+collect_operands (struct expr *e, enum expr_op op, struct expr **operands,
+                  int *n)
+{
+  if (e->op != op)
+    {
+      operands[(*n)++] = e;
+      return;
+    }
+
+  collect_operands (e->left, op, operands, n);
+  collect_operands (e->right, op, operands, n);
+}
+
+// Compute costs bottom up and sort the operands of every chain of -and or
+// -or by ascending cost, operands containing actions stay in place and
+// nothing is moved across them. The chain's inner nodes are reused for
+// rebuilding it as a left-deep tree. Returns -1 on errors.
+static int
+order (struct expr *e)
+{
+  switch (e->op)
+    {
+    case EXPR_NOT:
+      if (order (e->left) != 0)
+        return -1;
+
+      e->cost = e->left->cost;
+      e->effects = e->left->effects;
+      return 0;
+    case EXPR_AND:
+    case EXPR_OR:
+      break;
+    case EXPR_NAME:
+    case EXPR_TYPE:
+      e->cost = COST_CHEAP;
+      return 0;
+    case EXPR_PRUNE:
+    case EXPR_PRINT:
+    case EXPR_PRINTF:
+      e->cost = COST_CHEAP;
+      e->effects = 1;
+      return 0;
+    case EXPR_EXEC:
+      e->cost = COST_EXEC;
+      e->effects = 1;
+      return 0;
+    case EXPR_NAME_FROM:
+      e->cost = COST_PATTERNS;
+      return 0;
+    case EXPR_GREP:
+      e->cost = COST_GREP;
+      return 0;
+    default:
+      e->cost = COST_STAT;
+      return 0;
+    }
+
+  int n = count_operands (e, e->op);
+
+  struct expr **operands = malloc (n * sizeof (*operands));
+  struct expr **nodes = malloc ((n - 1) * sizeof (*nodes));
+
+  if (!operands || !nodes)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      free (operands);
+      free (nodes);
+      return -1;
+    }
+
+  int n_operands = 0;
+  collect_operands (e, e->op, operands, &n_operands);
+
+  // collect inner nodes (other than e itself) for reuse
+  int n_nodes = 0;
+  nodes[n_nodes++] = e;
+
+  for (int i = 0; i < n_nodes; ++i)
+    {
+      if (nodes[i]->left->op == e->op)
+        nodes[n_nodes++] = nodes[i]->left;
+      if (nodes[i]->right->op == e->op)
+        nodes[n_nodes++] = nodes[i]->right;
+    }
+
+  int err = 0;
+  for (int i = 0; i < n && !err; ++i)
+    err = order (operands[i]);
+
+  if (!err)
+    {
+      // stable insertion sort, chains are short
+      for (int i = 1; i < n; ++i)
+        {
+          struct expr *tmp = operands[i];
+          if (tmp->effects)
+            continue;
+
+          int j = i;
+          for (; j > 0 && !operands[j - 1]->effects
+                 && operands[j - 1]->cost > tmp->cost; --j)
+            {
+              operands[j] = operands[j - 1];
+            }
+
+          operands[j] = tmp;
+        }
+
+      // rebuild as ((o0 op o1) op o2) ..., e stays the root
+      struct expr *left = operands[0];
+      int cost = operands[0]->cost;
+      int effects = operands[0]->effects;
+
+      for (int i = 1; i < n; ++i)
+        {
+          struct expr *node = (i == n - 1) ? e : nodes[i];
+
+          node->left = left;
+          node->right = operands[i];
+
+          cost += operands[i]->cost;
+          node->cost = cost;
+
+          effects |= operands[i]->effects;
+          node->effects = effects;
+
+          left = node;
+        }
+    }
+
+  free (operands);
+  free (nodes);
+
+  return err;
+}
+
+// === Code generation =========================================================
+
+static int
+count_tests (struct expr const *e)
+{
+  switch (e->op)
+    {
+    case EXPR_AND:
+    case EXPR_OR:
+      return count_tests (e->left) + count_tests (e->right);
+    case EXPR_NOT:
+      return count_tests (e->left);
+    default:
+      return 1;
+    }
+}
+
+// emit e so that evaluation continues at on_true / on_false
+static void
+emit (struct expr_prog *prog, struct expr const *e, int on_true, int on_false)
+{
+  switch (e->op)
+    {
+    case EXPR_AND:
+      {
+        int right = prog->n_insns + count_tests (e->left);
+
+        emit (prog, e->left, right, on_false);
+        emit (prog, e->right, on_true, on_false);
+        break;
+      }
+    case EXPR_OR:
+      {
+        int right = prog->n_insns + count_tests (e->left);
+
+        emit (prog, e->left, on_true, right);
+        emit (prog, e->right, on_true, on_false);
+        break;
+      }
+    case EXPR_NOT:
+      emit (prog, e->left, on_false, on_true);
+      break;
+    default:
+      {
+        struct insn *insn = &prog->insns[prog->n_insns++];
+
+        if (e->op == EXPR_PRINT || e->op == EXPR_PRINTF
+            || e->op == EXPR_EXEC)
+          {
+            prog->print = 1;
+          }
+
+        insn->test = e;
+        insn->next[0] = on_false;
+        insn->next[1] = on_true;
+        break;
+      }
+    }
+}
+
+// the STATX_* field a test reads, 0 if it needs no stat data
+static unsigned
+stat_field (enum expr_op op)
+{
+  switch (op)
+    {
+    case EXPR_SIZE:
+      return STATX_SIZE;
+    case EXPR_MTIME:
+    case EXPR_NEWER:
+      return STATX_MTIME;
+    case EXPR_PERM:
+      return STATX_MODE;
+    case EXPR_USER:
+      return STATX_UID;
+    default:
+      return 0;
+    }
+}
+
+// Compile the expression given by the argc tokens in argv, an empty
+// expression is true for every entry.
+int
+expr_compile (struct expr_prog *prog, int argc, char **argv)
+{
+  prog->root = NULL;
+  prog->now = time (NULL);
+  prog->insns = NULL;
+  prog->n_insns = 0;
+  prog->print = 0;
+  prog->format = NULL;
+  prog->stat_mask = 0;
+
+  if (argc == 0)
+    return 0;
+
+  struct parser p = { argc, argv, 0 };
+
+  prog->root = parse_or (&p);
+  if (!prog->root)
+    return -1;
+
+  if (p.pos < argc)
+    {
+      fprintf (stderr, "%s: unexpected '%s' in expression\n", prog_name,
+               argv[p.pos]);
+      expr_free (prog);
+      return -1;
+    }
+
+  if (order (prog->root) != 0)
+    {
+      expr_free (prog);
+      return -1;
+    }
+
+  prog->insns = malloc (count_tests (prog->root) * sizeof (*prog->insns));
+  if (!prog->insns)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      expr_free (prog);
+      return -1;
+    }
+
+  emit (prog, prog->root, INSN_TRUE, INSN_FALSE);
+
+  // entries are written out in a single format, so -printf can neither be
+  // repeated nor mixed with -print
+  int plain = 0;
+
+  for (int i = 0; i < prog->n_insns; ++i)
+    {
+      struct expr const *t = prog->insns[i].test;
+
+      prog->stat_mask |= stat_field (t->op);
+
+      if (t->op == EXPR_PRINT)
+        plain = 1;
+
+      if (t->op != EXPR_PRINTF)
+        continue;
+
+      if (prog->format)
+        {
+          fprintf (stderr, "%s: -printf can only be given once\n", prog_name);
+          expr_free (prog);
+          return -1;
+        }
+
+      prog->format = t->arg.format;
+    }
+
+  if (prog->format && plain)
+    {
+      fprintf (stderr, "%s: -printf cannot be combined with -print\n",
+               prog_name);
+      expr_free (prog);
+      return -1;
+    }
+
+  return 0;
+}
+
+void
+expr_free (struct expr_prog *prog)
+{
+  free_tree (prog->root);
+  free (prog->insns);
+
+  prog->root = NULL;
+  prog->insns = NULL;
+  prog->n_insns = 0;
+}
+
+// whether evaluating the program may need stat data
+int
+expr_needs_stat (struct expr_prog const *prog)
+{
+  return prog->stat_mask != 0;
+}
+
+// start the pending batches of all -exec ... {} + actions
+int
+expr_flush (struct expr_prog const *prog)
+{
+  int err = 0;
+
+  for (int i = 0; i < prog->n_insns; ++i)
+    {
+      struct expr const *t = prog->insns[i].test;
+
+      if (t->op == EXPR_EXEC && t->arg.exec->batch
+          && exec_flush (t->arg.exec) != 0)
+        {
+          err = -1;
+        }
+    }
+
+  return err;
+}
+
+// === Evaluation ==============================================================
+
+static int
+cmp_num (enum expr_cmp cmp, unsigned long long value, unsigned long long n)
+{
+  switch (cmp)
+    {
+    case CMP_LT:
+      return value < n;
+    case CMP_GT:
+      return value > n;
+    default:
+      return value == n;
+    }
+}
+
+static int
+test (struct expr_prog const *prog, struct expr const *t, struct entry *e)
+{
+  switch (t->op)
+    {
+    case EXPR_NAME:
+      return matcher_match (&t->arg.name, e->name);
+    case EXPR_NAME_FROM:
+      return multi_matcher_match (&t->arg.names, e->name);
+    case EXPR_TYPE:
+      return (e->follow ? e->type : e->ltype) == t->arg.type;
+    case EXPR_PRUNE:
+      e->prune = 1;
+      return 1;
+    case EXPR_PRINT:
+    case EXPR_PRINTF:
+      e->print = 1;
+      return 1;
+    case EXPR_EXEC:
+      return exec_run (t->arg.exec, e);
+    case EXPR_GREP:
+      {
+        if ((e->follow ? e->type : e->ltype) != DT_REG)
+          return 0;
+
+        // entries of the index (and starting points) are named by path
+        char const *name = e->parent_fd == AT_FDCWD ? e->path : e->name;
+
+        return grep_file (&t->arg.grep, e->parent_fd, name, e->path,
+                          e->follow);
+      }
+    default:
+      break;
+    }
+
+  // everything else needs stat data, fetched only once per entry
+  if (entry_stat (e, stat_field (t->op)) != 0)
+    return 0;
+
+  switch (t->op)
+    {
+    case EXPR_SIZE:
+      {
+        // size is rounded up to whole units
+        unsigned long long unit = t->arg.num.unit;
+        unsigned long long size = (e->stx.stx_size + unit - 1) / unit;
+
+        return cmp_num (t->arg.num.cmp, size, t->arg.num.n);
+      }
+    case EXPR_MTIME:
+      {
+        time_t mtime = e->stx.stx_mtime.tv_sec;
+        if (mtime > prog->now)
+          return t->arg.num.cmp == CMP_LT;
+
+        unsigned long long days = (prog->now - mtime) / 86400;
+
+        return cmp_num (t->arg.num.cmp, days, t->arg.num.n);
+      }
+    case EXPR_NEWER:
+      return e->stx.stx_mtime.tv_sec > t->arg.newer.tv_sec
+             || (e->stx.stx_mtime.tv_sec == t->arg.newer.tv_sec
+                 && e->stx.stx_mtime.tv_nsec > t->arg.newer.tv_nsec);
+    case EXPR_PERM:
+      {
+        mode_t mode = e->stx.stx_mode & 07777;
+
+        switch (t->arg.perm.how)
+          {
+          case PERM_ALL:
+            return (mode & t->arg.perm.mode) == t->arg.perm.mode;
+          case PERM_ANY:
+            return t->arg.perm.mode == 0 || (mode & t->arg.perm.mode) != 0;
+          default:
+            return mode == t->arg.perm.mode;
+          }
+      }
+    case EXPR_USER:
+      return e->stx.stx_uid == t->arg.uid;
+    default:
+      return 0;
+    }
+}
+
+// Evaluate the program on e, returns whether e should be printed (that is,
+// whether the expression is true or, if it contains -print, whether -print
+// was reached and e has not been written out already ahead of a command run
+// by -exec). Actions leave their results in e.
+int
+expr_eval (struct expr_prog const *prog, struct entry *e)
+{
+  e->prune = e->print = e->printed = 0;
+
+  if (prog->n_insns == 0)
+    return 1;
+
+  int pc = 0;
+  while (pc >= 0)
+    {
+      struct insn const *insn = &prog->insns[pc];
+      pc = insn->next[test (prog, insn->test, e)];
+    }
+
+  return prog->print ? e->print && !e->printed : pc == INSN_TRUE;
+}
@@ -0,0 +1,448 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find.h"
+#include "format.h"
+
+// Records are built field by field straight into the caller's buffer,
+// format_max gives an upper bound on their size, so no field has to check
+// for space or go through printf.
+
+// fixed part of an NDJSON record, i.e. everything but the escaped path
+#define NDJSON_FIXED_MAX 160
+
+// binary record header following the length: size, mtime seconds, mtime
+// nanoseconds, inode, device and type
+#define BINARY_HEADER_SZ (8 + 8 + 4 + 8 + 8 + 1)
+
+// type letters as used by -type, indexed by DT_* value
+static char const type_letters[16] = "Upc?d?b?f?l?s???";
+
+// === Parsing =================================================================
+
+static int
+add_item (struct format *f, char field, char const *text, size_t len)
+{
+  struct format_item *tmp = realloc (f->items,
+                                     (f->n_items + 1) * sizeof (*tmp));
+  if (!tmp)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  f->items = tmp;
+  f->items[f->n_items++] = (struct format_item) { field, text, len };
+
+  return 0;
+}
+
+// split a -printf format into text and directives, escapes are resolved
+static int
+parse_printf (struct format *f, char const *fmt)
+{
+  f->text = malloc (strlen (fmt) + 1);
+  if (!f->text)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  char *out = f->text;
+  char const *start = out;
+
+  for (char const *p = fmt; *p; ++p)
+    {
+      if (*p == '\\')
+        {
+          switch (*++p)
+            {
+            case 'n': *out++ = '\n'; break;
+            case 't': *out++ = '\t'; break;
+            case 'r': *out++ = '\r'; break;
+            case '0': *out++ = '\0'; break;
+            case '\\': *out++ = '\\'; break;
+            default:
+              fprintf (stderr, "%s: -printf: unknown escape '\\%.1s'\n",
+                       prog_name, p);
+              return -1;
+            }
+
+          continue;
+        }
+
+      if (*p != '%')
+        {
+          *out++ = *p;
+          continue;
+        }
+
+      char field = *++p;
+
+      switch (field)
+        {
+        case '%':
+          *out++ = '%';
+          continue;
+        case 'p': case 'f': case 'y':
+          break;
+        case 's':
+          f->stat_mask |= STATX_SIZE;
+          break;
+        case 'm':
+          f->stat_mask |= STATX_MODE;
+          break;
+        case 'n':
+          f->stat_mask |= STATX_NLINK;
+          break;
+        case 'i': case 'D':
+          f->stat_mask |= STATX_INO;
+          break;
+        case 'T':
+          if (p[1] == '@')
+            {
+              field = '@';
+              ++p;
+              f->stat_mask |= STATX_MTIME;
+              break;
+            }
+          // fall through
+        default:
+          fprintf (stderr, "%s: -printf: unknown directive '%%%.1s'\n",
+                   prog_name, p);
+          return -1;
+        }
+
+      if (out > start && add_item (f, 0, start, out - start) != 0)
+        return -1;
+
+      if (add_item (f, field, NULL, 0) != 0)
+        return -1;
+
+      start = out;
+    }
+
+  if (out > start && add_item (f, 0, start, out - start) != 0)
+    return -1;
+
+  return 0;
+}
+
+// Set up output in the given format, fmt is the format string of -printf.
+int
+format_init (struct format *f, enum format_kind kind, char const *fmt)
+{
+  f->kind = kind;
+  f->items = NULL;
+  f->n_items = 0;
+  f->text = NULL;
+  f->stat_mask = 0;
+
+  if (kind != FORMAT_PRINTF)
+    {
+      f->stat_mask = STATX_SIZE | STATX_MTIME | STATX_INO;
+      return 0;
+    }
+
+  if (parse_printf (f, fmt) != 0)
+    {
+      format_free (f);
+      return -1;
+    }
+
+  return 0;
+}
+
+void
+format_free (struct format *f)
+{
+  free (f->items);
+  free (f->text);
+}
+
+// === Fields ==================================================================
+
+static size_t
+put_u64 (char *buf, uint64_t v)
+{
+  char digits[20];
+  size_t n = 0;
+
+  do
+    {
+      digits[n++] = '0' + v % 10;
+      v /= 10;
+    }
+  while (v > 0);
+
+  for (size_t i = 0; i < n; ++i)
+    buf[i] = digits[n - 1 - i];
+
+  return n;
+}
+
+static size_t
+put_octal (char *buf, unsigned v)
+{
+  char digits[12];
+  size_t n = 0;
+
+  do
+    {
+      digits[n++] = '0' + (v & 7);
+      v >>= 3;
+    }
+  while (v > 0);
+
+  for (size_t i = 0; i < n; ++i)
+    buf[i] = digits[n - 1 - i];
+
+  return n;
+}
+
+// seconds since the epoch with n_frac fractional digits (at least 9)
+static size_t
+put_time (char *buf, struct linux_statx_timestamp const *ts, int n_frac)
+{
+  size_t n = 0;
+  uint64_t sec = ts->tv_sec;
+  uint32_t nsec = ts->tv_nsec;
+
+  // times before the epoch are written as -s.f, i.e. -(s - f)
+  if (ts->tv_sec < 0)
+    {
+      buf[n++] = '-';
+      sec = -(uint64_t) ts->tv_sec;
+
+      if (nsec > 0)
+        {
+          --sec;
+          nsec = 1000000000 - nsec;
+        }
+    }
+
+  n += put_u64 (buf + n, sec);
+  buf[n++] = '.';
+
+  for (int i = 8; i >= 0; --i, nsec /= 10)
+    buf[n + i] = '0' + nsec % 10;
+
+  memset (buf + n + 9, '0', n_frac - 9);
+
+  return n + n_frac;
+}
+
+// copy s as the contents of a JSON string, other than quotes, backslashes
+// and control characters all bytes are copied as they are
+static size_t
+put_json (char *buf, char const *s, size_t len)
+{
+  static char const hex[] = "0123456789abcdef";
+
+  char *out = buf;
+  size_t i = 0;
+
+  for (;;)
+    {
+      size_t run = i;
+      while (run < len && (unsigned char) s[run] >= 0x20 && s[run] != '"'
+             && s[run] != '\\')
+        {
+          ++run;
+        }
+
+      memcpy (out, s + i, run - i);
+      out += run - i;
+
+      if (run == len)
+        break;
+
+      unsigned char c = s[run];
+      i = run + 1;
+
+      *out++ = '\\';
+
+      switch (c)
+        {
+        case '"': case '\\': *out++ = c; break;
+        case '\n': *out++ = 'n'; break;
+        case '\t': *out++ = 't'; break;
+        case '\r': *out++ = 'r'; break;
+        default:
+          *out++ = 'u';
+          *out++ = '0';
+          *out++ = '0';
+          *out++ = hex[c >> 4];
+          *out++ = hex[c & 15];
+        }
+    }
+
+  return out - buf;
+}
+
+static size_t
+put_str (char *buf, char const *s, size_t len)
+{
+  memcpy (buf, s, len);
+  return len;
+}
+
+// === Records =================================================================
+
+// upper bound on the size of the record of an entry with a path of
+// path_len bytes
+size_t
+format_max (struct format const *f, size_t path_len)
+{
+  switch (f->kind)
+    {
+    case FORMAT_NDJSON:
+      return 6 * path_len + NDJSON_FIXED_MAX;
+    case FORMAT_BINARY:
+      return 4 + BINARY_HEADER_SZ + path_len;
+    case FORMAT_PRINTF:
+      break;
+    }
+
+  size_t n = 0;
+
+  for (int i = 0; i < f->n_items; ++i)
+    {
+      switch (f->items[i].field)
+        {
+        case 0: n += f->items[i].len; break;
+        case 'p': case 'f': n += path_len; break;
+        case 'y': n += 1; break;
+        case '@': n += 32; break;
+        default: n += 24; break;
+        }
+    }
+
+  return n;
+}
+
+static size_t
+printf_entry (struct format const *f, struct entry const *e, size_t path_len,
+              char *buf)
+{
+  size_t n = 0;
+
+  for (int i = 0; i < f->n_items; ++i)
+    {
+      struct format_item const *it = &f->items[i];
+
+      switch (it->field)
+        {
+        case 0:
+          n += put_str (buf + n, it->text, it->len);
+          break;
+        case 'p':
+          n += put_str (buf + n, e->path, path_len);
+          break;
+        case 'f':
+          {
+            // the last component, the root is named by the path it was
+            // given as
+            char const *name = strrchr (e->path, '/');
+            name = (name && name[1]) ? name + 1 : e->path;
+
+            n += put_str (buf + n, name, e->path + path_len - name);
+            break;
+          }
+        case 'y':
+          buf[n++] = type_letters[e->type & 15];
+          break;
+        case 's':
+          n += put_u64 (buf + n, e->stx.stx_size);
+          break;
+        case 'm':
+          n += put_octal (buf + n, e->stx.stx_mode & 07777);
+          break;
+        case 'n':
+          n += put_u64 (buf + n, e->stx.stx_nlink);
+          break;
+        case 'i':
+          n += put_u64 (buf + n, e->stx.stx_ino);
+          break;
+        case 'D':
+          n += put_u64 (buf + n, xstat_dev (&e->stx));
+          break;
+        case '@':
+          n += put_time (buf + n, &e->stx.stx_mtime, 10);
+          break;
+        }
+    }
+
+  return n;
+}
+
+#define PUT_LIT(buf, s) put_str (buf, s, sizeof (s) - 1)
+
+static size_t
+ndjson_entry (struct entry const *e, size_t path_len, char *buf)
+{
+  size_t n = 0;
+
+  n += PUT_LIT (buf + n, "{\"path\":\"");
+  n += put_json (buf + n, e->path, path_len);
+  n += PUT_LIT (buf + n, "\",\"type\":\"");
+  buf[n++] = type_letters[e->type & 15];
+  n += PUT_LIT (buf + n, "\",\"size\":");
+  n += put_u64 (buf + n, e->stx.stx_size);
+  n += PUT_LIT (buf + n, ",\"mtime\":");
+  n += put_time (buf + n, &e->stx.stx_mtime, 9);
+  n += PUT_LIT (buf + n, ",\"ino\":");
+  n += put_u64 (buf + n, e->stx.stx_ino);
+  n += PUT_LIT (buf + n, ",\"dev\":");
+  n += put_u64 (buf + n, xstat_dev (&e->stx));
+  n += PUT_LIT (buf + n, "}\n");
+
+  return n;
+}
+
+static size_t
+binary_entry (struct entry const *e, size_t path_len, char *buf)
+{
+  uint32_t len = BINARY_HEADER_SZ + path_len;
+  uint64_t size = e->stx.stx_size;
+  int64_t sec = e->stx.stx_mtime.tv_sec;
+  uint32_t nsec = e->stx.stx_mtime.tv_nsec;
+  uint64_t ino = e->stx.stx_ino;
+  uint64_t dev = xstat_dev (&e->stx);
+
+  size_t n = 0;
+
+  n += put_str (buf + n, (char const *) &len, 4);
+  n += put_str (buf + n, (char const *) &size, 8);
+  n += put_str (buf + n, (char const *) &sec, 8);
+  n += put_str (buf + n, (char const *) &nsec, 4);
+  n += put_str (buf + n, (char const *) &ino, 8);
+  n += put_str (buf + n, (char const *) &dev, 8);
+  buf[n++] = type_letters[e->type & 15];
+  n += put_str (buf + n, e->path, path_len);
+
+  return n;
+}
+
+// Write the record of e, whose path is path_len bytes long, to buf, which
+// has to hold format_max bytes. The stat fields in f->stat_mask have to be
+// available. Returns the size of the record.
+size_t
+format_entry (struct format const *f, struct entry const *e, size_t path_len,
+              char *buf)
+{
+  switch (f->kind)
+    {
+    case FORMAT_NDJSON:
+      return ndjson_entry (e, path_len, buf);
+    case FORMAT_BINARY:
+      return binary_entry (e, path_len, buf);
+    case FORMAT_PRINTF:
+      break;
+    }
+
+  return printf_entry (f, e, path_len, buf);
+}
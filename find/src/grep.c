@@ -0,0 +1,226 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "find.h"
+#include "grep.h"
+
+// Small files are read into a buffer on the stack, larger ones are read in
+// windows of GREP_WINDOW bytes which overlap by the pattern length less one,
+// so memory use does not grow with the file. They are not mapped: a file
+// truncated while being searched would raise SIGBUS on the mapping.
+// Within a window, candidate positions are found 16 bytes at a time by
+// comparing the first and the last byte of the pattern at once (GCC vector
+// extensions, which compile to SSE2 or NEON), only candidates are compared
+// in full.
+
+#define GREP_SMALL (16 * 1024)
+#define GREP_WINDOW (4 * 1024 * 1024)
+
+typedef unsigned char bytes16 __attribute__ ((vector_size (16)));
+typedef signed char mask16 __attribute__ ((vector_size (16)));
+
+int
+grep_compile (struct grep_pattern *g, char const *pattern)
+{
+  g->len = strlen (pattern);
+
+  g->str = malloc (g->len + 1);
+  if (!g->str)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  memcpy (g->str, pattern, g->len + 1);
+
+  return 0;
+}
+
+void
+grep_free (struct grep_pattern *g)
+{
+  free (g->str);
+}
+
+// === Search ==================================================================
+
+// whether the pattern occurs in the n bytes at buf
+static int
+search (struct grep_pattern const *g, unsigned char const *buf, size_t n)
+{
+  size_t len = g->len;
+  unsigned char const *pat = (unsigned char const *) g->str;
+
+  if (len == 0)
+    return 1;
+
+  if (len > n)
+    return 0;
+
+  if (len == 1)
+    return memchr (buf, pat[0], n) != NULL;
+
+  bytes16 first, last;
+  memset (&first, pat[0], sizeof (first));
+  memset (&last, pat[len - 1], sizeof (last));
+
+  // positions at which the pattern may start
+  size_t end = n - len + 1;
+  size_t i = 0;
+
+  for (; i + sizeof (bytes16) <= end; i += sizeof (bytes16))
+    {
+      bytes16 a, b;
+      memcpy (&a, buf + i, sizeof (a));
+      memcpy (&b, buf + i + len - 1, sizeof (b));
+
+      mask16 hits = (a == first) & (b == last);
+
+      uint64_t any[2];
+      memcpy (any, &hits, sizeof (any));
+
+      if ((any[0] | any[1]) == 0)
+        continue;
+
+      for (size_t j = 0; j < sizeof (bytes16); ++j)
+        {
+          if (hits[j] && memcmp (buf + i + j + 1, pat + 1, len - 2) == 0)
+            return 1;
+        }
+    }
+
+  for (; i < end; ++i)
+    {
+      if (buf[i] == pat[0] && buf[i + len - 1] == pat[len - 1]
+          && memcmp (buf + i + 1, pat + 1, len - 2) == 0)
+        {
+          return 1;
+        }
+    }
+
+  return 0;
+}
+
+// search a file of at most GREP_SMALL bytes
+static int
+search_small (struct grep_pattern const *g, int fd)
+{
+  unsigned char buf[GREP_SMALL];
+  size_t n = 0;
+
+  while (n < sizeof (buf))
+    {
+      ssize_t r = read (fd, buf + n, sizeof (buf) - n);
+      if (r == -1 && errno == EINTR)
+        continue;
+
+      if (r == -1)
+        return -1;
+
+      if (r == 0)
+        break;
+
+      n += r;
+    }
+
+  return search (g, buf, n);
+}
+
+// search a larger file window by window, each window starting with the last
+// pattern length less one bytes of the one before so that matches across the
+// border are found
+static int
+search_windows (struct grep_pattern const *g, int fd)
+{
+  size_t keep = g->len ? g->len - 1 : 0;
+  size_t cap = GREP_WINDOW + keep;
+
+  unsigned char *buf = malloc (cap);
+  if (!buf)
+    return -1;
+
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  int found = 0;
+  size_t n = 0;     // bytes in buf
+  size_t seen = 0;  // of which were searched already
+
+  for (;;)
+    {
+      ssize_t r = read (fd, buf + n, cap - n);
+      if (r == -1 && errno == EINTR)
+        continue;
+
+      if (r == -1)
+        {
+          found = -1;
+          break;
+        }
+
+      n += r;
+      if (r > 0 && n < cap)
+        continue;
+
+      if (n > seen)
+        found = search (g, buf, n);
+
+      if (found || r == 0)
+        break;
+
+      memmove (buf, buf + n - keep, keep);
+      n = seen = keep;
+    }
+
+  free (buf);
+
+  return found;
+}
+
+// Returns whether name in dirfd (path for error messages) is a regular file
+// containing the pattern, following symlinks if follow is set. Files that
+// cannot be read are reported and do not match.
+int
+grep_file (struct grep_pattern const *g, int dirfd, char const *name,
+           char const *path, int follow)
+{
+  int flags = O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK;
+  if (!follow)
+    flags |= O_NOFOLLOW;
+
+  int fd = openat (dirfd, name, flags);
+  if (fd == -1)
+    {
+      if (errno != ENOENT && errno != ELOOP)
+        fprintf (stderr, "%s: %s: %s\n", prog_name, path, strerror (errno));
+
+      return 0;
+    }
+
+  int found = 0;
+
+  struct stat sb;
+  if (fstat (fd, &sb) == -1)
+    found = -1;
+  else if (!S_ISREG (sb.st_mode))
+    found = 0;
+  else if (sb.st_size <= GREP_SMALL)
+    found = search_small (g, fd);
+  else
+    found = search_windows (g, fd);
+
+  if (found == -1)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, path, strerror (errno));
+      found = 0;
+    }
+
+  close (fd);
+
+  return found;
+}
@@ -0,0 +1,797 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "dirread.h"
+#include "entry.h"
+#include "expr.h"
+#include "find.h"
+#include "format.h"
+#include "index.h"
+#include "output.h"
+#include "pathbuf.h"
+
+#define MAGIC_LEN (sizeof (INDEX_MAGIC) - 1)
+
+// === Reading =================================================================
+
+// sequential reader over a mapped index file
+struct index_reader
+{
+  char const *file;
+
+  unsigned char *map;
+  size_t sz;
+  unsigned char const *pos, *end;
+
+  // the record read last
+  int valid;
+  struct path_buf path;
+  unsigned char type;
+  struct timespec mtime;
+};
+
+static int
+reader_open (struct index_reader *r, char const *file)
+{
+  r->file = file;
+  r->map = NULL;
+  r->valid = 0;
+
+  int fd = open (file, O_RDONLY);
+  if (fd == -1)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, file, strerror (errno));
+      return -1;
+    }
+
+  struct stat sb;
+  if (fstat (fd, &sb) == -1)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, file, strerror (errno));
+      close (fd);
+      return -1;
+    }
+
+  if ((size_t) sb.st_size < MAGIC_LEN)
+    {
+      fprintf (stderr, "%s: %s: not an index file\n", prog_name, file);
+      close (fd);
+      return -1;
+    }
+
+  r->sz = sb.st_size;
+  r->map = mmap (NULL, r->sz, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close (fd);
+
+  if (r->map == MAP_FAILED)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, file, strerror (errno));
+      return -1;
+    }
+
+  madvise (r->map, r->sz, MADV_SEQUENTIAL);
+
+  if (memcmp (r->map, INDEX_MAGIC, MAGIC_LEN) != 0)
+    {
+      fprintf (stderr, "%s: %s: not an index file\n", prog_name, file);
+      munmap (r->map, r->sz);
+      return -1;
+    }
+
+  if (path_buf_init (&r->path) != 0)
+    {
+      munmap (r->map, r->sz);
+      return -1;
+    }
+
+  r->pos = r->map + MAGIC_LEN;
+  r->end = r->map + r->sz;
+
+  return 0;
+}
+
+static void
+reader_close (struct index_reader *r)
+{
+  munmap (r->map, r->sz);
+  path_buf_free (&r->path);
+}
+
+static int
+get_varint (struct index_reader *r, uint64_t *v)
+{
+  *v = 0;
+
+  for (int shift = 0; shift < 64 && r->pos < r->end; shift += 7)
+    {
+      unsigned char c = *r->pos++;
+
+      *v |= (uint64_t) (c & 0x7f) << shift;
+
+      if (!(c & 0x80))
+        return 0;
+    }
+
+  return -1;
+}
+
+// Advance to the next record, returns 1 if there is one, 0 at the end of the
+// index and -1 if the index is corrupt.
+static int
+reader_next (struct index_reader *r)
+{
+  r->valid = 0;
+
+  if (r->pos == r->end)
+    return 0;
+
+  uint64_t prefix, suffix;
+
+  // the suffix is followed by at least the type byte
+  if (get_varint (r, &prefix) != 0 || prefix > r->path.len
+      || get_varint (r, &suffix) != 0
+      || suffix >= (uint64_t) (r->end - r->pos)
+      || memchr (r->pos, '\0', suffix))
+    {
+      fprintf (stderr, "%s: %s: corrupt index\n", prog_name, r->file);
+      return -1;
+    }
+
+  path_buf_truncate (&r->path, prefix);
+
+  if (path_buf_append (&r->path, (char const *) r->pos, suffix) != 0)
+    return -1;
+
+  r->pos += suffix;
+  r->type = *r->pos++;
+
+  if (r->type == DT_DIR)
+    {
+      uint64_t sec, nsec;
+      if (get_varint (r, &sec) != 0 || get_varint (r, &nsec) != 0)
+        {
+          fprintf (stderr, "%s: %s: corrupt index\n", prog_name, r->file);
+          return -1;
+        }
+
+      r->mtime.tv_sec = sec;
+      r->mtime.tv_nsec = nsec;
+    }
+
+  r->valid = 1;
+
+  return 1;
+}
+
+// === Writing =================================================================
+
+struct index_writer
+{
+  FILE *fp;
+  struct path_buf prev;  // path of the previous record
+};
+
+static void
+put_varint (FILE *fp, uint64_t v)
+{
+  while (v >= 0x80)
+    {
+      putc ((v & 0x7f) | 0x80, fp);
+      v >>= 7;
+    }
+
+  putc (v, fp);
+}
+
+// append a record, write errors are detected when the file is closed
+static int
+writer_add (struct index_writer *w, char const *path, size_t len,
+            unsigned char type, struct timespec const *mtime)
+{
+  size_t prefix = 0;
+  while (prefix < len && prefix < w->prev.len
+         && path[prefix] == w->prev.buf[prefix])
+    {
+      ++prefix;
+    }
+
+  put_varint (w->fp, prefix);
+  put_varint (w->fp, len - prefix);
+  fwrite (path + prefix, 1, len - prefix, w->fp);
+  putc (type, w->fp);
+
+  if (type == DT_DIR)
+    {
+      put_varint (w->fp, (uint64_t) mtime->tv_sec);
+      put_varint (w->fp, (uint64_t) mtime->tv_nsec);
+    }
+
+  path_buf_truncate (&w->prev, prefix);
+
+  return path_buf_append (&w->prev, path + prefix, len - prefix);
+}
+
+// === Building ================================================================
+
+struct child
+{
+  size_t off;         // offset of the name in the list's name buffer
+  char const *name;   // set once all entries have been read
+  unsigned char type;
+};
+
+// entries of a directory being read, sorted by name
+struct child_list
+{
+  char *names;
+  size_t names_len, names_cap;
+
+  struct child *children;
+  size_t n, cap;
+};
+
+// what the previous index recorded about an entry
+struct old_entry
+{
+  int valid;
+  unsigned char type;
+  struct timespec mtime;
+};
+
+struct builder
+{
+  struct find_opts const *opts;
+
+  struct index_reader old;  // previous index, old.valid is 0 once exhausted
+  struct index_writer w;
+
+  struct path_buf path;
+  struct dir_reader dr;
+
+  // one child list per depth, reused for all directories read at that depth
+  struct child_list **lists;
+  int n_lists;
+
+  int failed;  // some entry could not be stat'ed or read, the index is short
+};
+
+static struct child_list *
+get_list (struct builder *b, int depth)
+{
+  if (depth < b->n_lists)
+    return b->lists[depth];
+
+  // levels below reused directories may have been skipped
+  struct child_list **tmp = realloc (b->lists, (depth + 1) * sizeof (*tmp));
+  if (!tmp)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  b->lists = tmp;
+
+  while (b->n_lists <= depth)
+    {
+      struct child_list *l = calloc (1, sizeof (*l));
+      if (!l)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return NULL;
+        }
+
+      b->lists[b->n_lists++] = l;
+    }
+
+  return b->lists[depth];
+}
+
+static int
+add_child (struct child_list *l, char const *name, unsigned char type)
+{
+  size_t len = strlen (name) + 1;
+
+  if (l->names_len + len > l->names_cap)
+    {
+      size_t cap = l->names_cap ? l->names_cap : 4096;
+      while (l->names_len + len > cap)
+        cap *= 2;
+
+      char *tmp = realloc (l->names, cap);
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      l->names = tmp;
+      l->names_cap = cap;
+    }
+
+  if (l->n == l->cap)
+    {
+      size_t cap = l->cap ? 2 * l->cap : 64;
+
+      struct child *tmp = realloc (l->children, cap * sizeof (*tmp));
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      l->children = tmp;
+      l->cap = cap;
+    }
+
+  memcpy (l->names + l->names_len, name, len);
+
+  struct child *c = &l->children[l->n++];
+  c->off = l->names_len;
+  c->type = type;
+
+  l->names_len += len;
+
+  return 0;
+}
+
+static int
+child_cmp (void const *a, void const *b)
+{
+  return strcmp (((struct child const *) a)->name,
+                 ((struct child const *) b)->name);
+}
+
+// report that the entry at b->path could not be indexed, entries that
+// vanished in the meantime are left out silently
+static void
+builder_error (struct builder *b)
+{
+  if (errno == ENOENT)
+    return;
+
+  fprintf (stderr, "%s: %s: %s\n", prog_name, b->path.buf, strerror (errno));
+  b->failed = 1;
+}
+
+// lstat the entry at b->path, paths exceeding PATH_MAX are stat'ed relative
+// to their parent, which open_dir opens piecewise
+static int
+stat_entry (struct builder *b, struct stat *sb)
+{
+  if (lstat (b->path.buf, sb) == 0)
+    return 0;
+
+  char *slash = strrchr (b->path.buf, '/');
+  if (errno != ENAMETOOLONG || !slash)
+    return -1;
+
+  *slash = '\0';
+  int fd = open_dir (b->path.buf);
+  *slash = '/';
+
+  if (fd == -1)
+    return -1;
+
+  int ret = fstatat (fd, slash + 1, sb, AT_SYMLINK_NOFOLLOW);
+
+  int err = errno;
+  close (fd);
+  errno = err;
+
+  return ret;
+}
+
+// Read the entries of the directory at b->path into l sorted by name,
+// returns 1 if the directory could not be opened.
+static int
+read_children (struct builder *b, struct child_list *l)
+{
+  l->names_len = l->n = 0;
+
+  int fd = open_dir (b->path.buf);
+  if (fd == -1)
+    {
+      builder_error (b);
+      return 1;
+    }
+
+  dir_reader_reset (&b->dr, fd);
+
+  int ret;
+  struct dir_entry entry;
+
+  while ((ret = dir_read (&b->dr, &entry)) == 1)
+    {
+      if (add_child (l, entry.name, entry.type) != 0)
+        {
+          ret = -1;
+          break;
+        }
+    }
+
+  close (fd);
+
+  if (ret == -1)
+    return -1;
+
+  for (size_t i = 0; i < l->n; ++i)
+    l->children[i].name = l->names + l->children[i].off;
+
+  qsort (l->children, l->n, sizeof (*l->children), child_cmp);
+
+  return 0;
+}
+
+// take the current record of the previous index and advance past it
+static int
+take_old (struct builder *b, struct old_entry *o)
+{
+  o->valid = 1;
+  o->type = b->old.type;
+  o->mtime = b->old.mtime;
+
+  return reader_next (&b->old) < 0 ? -1 : 0;
+}
+
+// Write the record of the entry at b->path and, for directories, the records
+// of everything below it. Directories whose mtime matches the one recorded in
+// the previous index are not read again, their entries are copied from there.
+static int
+build_entry (struct builder *b, int depth, unsigned char type,
+             struct old_entry const *old)
+{
+  struct stat sb;
+
+  if (type == DT_UNKNOWN || type == DT_DIR)
+    {
+      if (stat_entry (b, &sb) == -1)
+        {
+          builder_error (b);
+          return 0;
+        }
+
+      type = IFTODT (sb.st_mode);
+    }
+
+  if (type != DT_DIR)
+    return writer_add (&b->w, b->path.buf, b->path.len, type, NULL);
+
+  struct timespec mtime = sb.st_mtim;
+
+  // directories on other file systems are recorded but never read
+  if (b->opts->xdev && sb.st_dev != b->opts->dev)
+    {
+      mtime.tv_sec = mtime.tv_nsec = 0;
+      return writer_add (&b->w, b->path.buf, b->path.len, type, &mtime);
+    }
+
+  int reuse = old->valid && old->type == DT_DIR
+              && old->mtime.tv_sec == mtime.tv_sec
+              && old->mtime.tv_nsec == mtime.tv_nsec
+              && (mtime.tv_sec != 0 || mtime.tv_nsec != 0);
+
+  struct child_list *l = NULL;
+
+  if (!reuse)
+    {
+      if (!(l = get_list (b, depth)))
+        return -1;
+
+      int ret = read_children (b, l);
+      if (ret == -1)
+        return -1;
+
+      // make sure an unreadable directory is read again next time
+      if (ret == 1)
+        mtime.tv_sec = mtime.tv_nsec = 0;
+    }
+
+  if (writer_add (&b->w, b->path.buf, b->path.len, type, &mtime) != 0)
+    return -1;
+
+  size_t len = b->path.len;
+
+  if (reuse)
+    {
+      while (b->old.valid && path_below (b->old.path.buf, b->path.buf, len))
+        {
+          char const *name = b->old.path.buf + len + 1;
+
+          if (path_buf_push (&b->path, name) != 0)
+            return -1;
+
+          struct old_entry o;
+          if (take_old (b, &o) != 0)
+            return -1;
+
+          int err = build_entry (b, depth + 1, o.type, &o);
+
+          path_buf_truncate (&b->path, len);
+
+          if (err != 0)
+            return -1;
+        }
+
+      return 0;
+    }
+
+  for (size_t i = 0; i < l->n; ++i)
+    {
+      struct child const *c = &l->children[i];
+
+      if (path_buf_push (&b->path, c->name) != 0)
+        return -1;
+
+      // skip entries that no longer exist
+      while (b->old.valid && path_cmp (b->old.path.buf, b->path.buf) < 0)
+        {
+          if (reader_next (&b->old) < 0)
+            return -1;
+        }
+
+      struct old_entry o = { 0 };
+
+      if (b->old.valid && strcmp (b->old.path.buf, b->path.buf) == 0
+          && take_old (b, &o) != 0)
+        {
+          return -1;
+        }
+
+      int err = build_entry (b, depth + 1, c->type, &o);
+
+      path_buf_truncate (&b->path, len);
+
+      if (err != 0)
+        return -1;
+    }
+
+  // drop whatever else the previous index has below this directory
+  while (b->old.valid && path_below (b->old.path.buf, b->path.buf, len))
+    {
+      if (reader_next (&b->old) < 0)
+        return -1;
+    }
+
+  return 0;
+}
+
+// Index the tree below root into file, if file already holds an index of
+// root only directories modified since are read again. The new index is
+// written next to file and renamed over it when complete. Entries that cannot
+// be read are reported and left out, the index is still written but 1 is
+// returned.
+int
+index_build (struct find_opts const *opts, char const *root, char const *file)
+{
+  struct builder b;
+
+  b.opts = opts;
+  b.w.fp = NULL;
+  b.lists = NULL;
+  b.n_lists = 0;
+  b.failed = 0;
+
+  int have_old = 0;
+
+  if (access (file, F_OK) == 0)
+    {
+      if (reader_open (&b.old, file) != 0)
+        return 1;
+
+      have_old = 1;
+
+      if (reader_next (&b.old) < 0)
+        {
+          reader_close (&b.old);
+          return 1;
+        }
+
+      // an index of another directory is of no use
+      if (b.old.valid && strcmp (b.old.path.buf, root) != 0)
+        b.old.valid = 0;
+    }
+  else
+    b.old.valid = 0;
+
+  char *tmp_file = malloc (strlen (file) + sizeof (".tmp"));
+  if (!tmp_file)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+
+      if (have_old)
+        reader_close (&b.old);
+
+      return 1;
+    }
+
+  sprintf (tmp_file, "%s.tmp", file);
+
+  int err = 1;
+
+  if (path_buf_init (&b.path) != 0)
+    goto out_tmp;
+
+  if (path_buf_init (&b.w.prev) != 0)
+    goto out_path;
+
+  if (dir_reader_init (&b.dr) != 0)
+    goto out_prev;
+
+  if (path_buf_set (&b.path, root) != 0)
+    goto out_dr;
+
+  b.w.fp = fopen (tmp_file, "w");
+  if (!b.w.fp)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, tmp_file, strerror (errno));
+      goto out_dr;
+    }
+
+  fwrite (INDEX_MAGIC, 1, MAGIC_LEN, b.w.fp);
+
+  struct old_entry o = { 0 };
+
+  if (!(b.old.valid && take_old (&b, &o) != 0))
+    err = build_entry (&b, 0, DT_UNKNOWN, &o) == 0 ? 0 : 1;
+
+  if (ferror (b.w.fp))
+    {
+      fprintf (stderr, "%s: %s: write error\n", prog_name, tmp_file);
+      err = 1;
+    }
+
+  if (fclose (b.w.fp) != 0 && !err)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, tmp_file, strerror (errno));
+      err = 1;
+    }
+
+  if (!err && rename (tmp_file, file) == -1)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, file, strerror (errno));
+      err = 1;
+    }
+
+  if (err)
+    unlink (tmp_file);
+
+  // the index is kept, missing what could not be read
+  if (b.failed)
+    err = 1;
+
+out_dr:
+  dir_reader_free (&b.dr);
+out_prev:
+  path_buf_free (&b.w.prev);
+out_path:
+  path_buf_free (&b.path);
+out_tmp:
+  free (tmp_file);
+
+  for (int i = 0; i < b.n_lists; ++i)
+    {
+      free (b.lists[i]->names);
+      free (b.lists[i]->children);
+      free (b.lists[i]);
+    }
+
+  free (b.lists);
+
+  if (have_old)
+    reader_close (&b.old);
+
+  return err;
+}
+
+// === Querying ================================================================
+
+// Print all indexed entries satisfying the expression, which must not need
+// stat data. -mindepth, -maxdepth and -prune apply as during traversal.
+int
+index_query (struct find_opts const *opts, char const *file)
+{
+  struct index_reader r;
+  if (reader_open (&r, file) != 0)
+    return 1;
+
+  struct out_buf out;
+  if (out_init (&out, STDOUT_FILENO, opts->print0 ? '\0' : '\n') != 0)
+    {
+      reader_close (&r);
+      return 1;
+    }
+
+  // directory whose records are being skipped, if any
+  struct path_buf skip;
+  if (path_buf_init (&skip) != 0)
+    {
+      out_free (&out);
+      reader_close (&r);
+      return 1;
+    }
+
+  // output printed so far precedes that of commands run by -exec
+  out_bind (&out, opts->format);
+
+  int skipping = 0;
+
+  int err = 0;
+  size_t root_len = 0;
+  int first = 1;
+
+  int ret;
+  while ((ret = reader_next (&r)) == 1)
+    {
+      if (skipping && path_below (r.path.buf, skip.buf, skip.len))
+        continue;
+
+      skipping = 0;
+
+      if (first)
+        root_len = r.path.len;
+
+      int depth = 0;
+      for (char const *p = r.path.buf + root_len; *p; ++p)
+        depth += (*p == '/');
+
+      if (depth > opts->max_depth)
+        continue;
+
+      struct entry e;
+
+      // like during traversal, the root is named by the path it was given as
+      char const *name = strrchr (r.path.buf, '/');
+
+      e.parent_fd = AT_FDCWD;
+      e.name = (first || !name) ? r.path.buf : name + 1;
+      e.path = r.path.buf;
+      e.ltype = e.type = r.type;
+      e.follow = 0;
+      e.have = e.want = 0;
+      e.prune = 0;
+
+      first = 0;
+
+      if (depth >= opts->min_depth && expr_eval (opts->expr, &e)
+          && out_entry (&out, opts->format, &e, r.path.len) != 0)
+        {
+          err = 1;
+          break;
+        }
+
+      if (e.prune && e.type == DT_DIR)
+        {
+          if (path_buf_set (&skip, r.path.buf) != 0)
+            {
+              err = 1;
+              break;
+            }
+
+          skipping = 1;
+        }
+    }
+
+  path_buf_free (&skip);
+
+  if (ret == -1)
+    err = 1;
+
+  out_bind (NULL, NULL);
+
+  if (out_free (&out) != 0)
+    err = 1;
+
+  reader_close (&r);
+
+  return err;
+}
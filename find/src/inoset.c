@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find.h"
+#include "inoset.h"
+
+#define INO_SET_INIT_SZ 64  // must be a power of two
+
+// The set uses open addressing with linear probing over a flat array of
+// inline keys, removal shifts subsequent entries of the same probe sequence
+// backwards so no tombstones are needed.
+
+struct ino_slot
+{
+  dev_t dev;
+  ino_t ino;
+  int used;
+};
+
+static size_t
+ino_set_idx (struct ino_set const *set, dev_t dev, ino_t ino)
+{
+  // 64-bit finalizer of MurmurHash3 applied to the combined key
+  uint64_t h = (uint64_t) ino ^ ((uint64_t) dev * 0x9e3779b97f4a7c15ULL);
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h & (set->sz - 1);
+}
+
+static struct ino_slot *
+ino_set_find (struct ino_set const *set, dev_t dev, ino_t ino)
+{
+  size_t idx = ino_set_idx (set, dev, ino);
+
+  for (;;)
+    {
+      struct ino_slot *slot = &set->slots[idx];
+
+      if (!slot->used || (slot->dev == dev && slot->ino == ino))
+        return slot;
+
+      idx = (idx + 1) & (set->sz - 1);
+    }
+}
+
+static int
+ino_set_grow (struct ino_set *set)
+{
+  struct ino_slot *old = set->slots;
+  size_t old_sz = set->sz;
+
+  struct ino_slot *tmp = calloc (2 * old_sz, sizeof (*tmp));
+  if (!tmp)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  set->slots = tmp;
+  set->sz = 2 * old_sz;
+
+  for (size_t i = 0; i < old_sz; ++i)
+    {
+      if (old[i].used)
+        *ino_set_find (set, old[i].dev, old[i].ino) = old[i];
+    }
+
+  free (old);
+
+  return 0;
+}
+
+int
+ino_set_init (struct ino_set *set)
+{
+  set->slots = calloc (INO_SET_INIT_SZ, sizeof (*set->slots));
+  if (!set->slots)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  set->sz = INO_SET_INIT_SZ;
+  set->used = 0;
+
+  return 0;
+}
+
+void
+ino_set_free (struct ino_set *set)
+{
+  free (set->slots);
+
+  set->slots = NULL;
+  set->sz = set->used = 0;
+}
+
+// Returns 1 if the key was inserted, 0 if it was already present and -1 on
+// errors.
+int
+ino_set_insert (struct ino_set *set, dev_t dev, ino_t ino)
+{
+  // keep load factor below 3/4
+  if (4 * (set->used + 1) > 3 * set->sz && ino_set_grow (set) != 0)
+    return -1;
+
+  struct ino_slot *slot = ino_set_find (set, dev, ino);
+  if (slot->used)
+    return 0;
+
+  slot->dev = dev;
+  slot->ino = ino;
+  slot->used = 1;
+
+  ++set->used;
+
+  return 1;
+}
+
+int
+ino_set_contains (struct ino_set const *set, dev_t dev, ino_t ino)
+{
+  return ino_set_find (set, dev, ino)->used;
+}
+
+void
+ino_set_remove (struct ino_set *set, dev_t dev, ino_t ino)
+{
+  size_t mask = set->sz - 1;
+  size_t idx = ino_set_find (set, dev, ino) - set->slots;
+
+  if (!set->slots[idx].used)
+    return;
+
+  // move entries that would become unreachable into the hole
+  size_t hole = idx;
+
+  for (;;)
+    {
+      idx = (idx + 1) & mask;
+
+      struct ino_slot *slot = &set->slots[idx];
+      if (!slot->used)
+        break;
+
+      size_t home = ino_set_idx (set, slot->dev, slot->ino);
+
+      // entry may only move if its home is not within (hole, idx]
+      if (((idx - home) & mask) >= ((idx - hole) & mask))
+        {
+          set->slots[hole] = *slot;
+          hole = idx;
+        }
+    }
+
+  set->slots[hole].used = 0;
+
+  --set->used;
+}
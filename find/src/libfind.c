@@ -0,0 +1,462 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "du.h"
+#include "dupes.h"
+#include "entry.h"
+#include "exec.h"
+#include "expr.h"
+#include "find.h"
+#include "format.h"
+#include "libfind.h"
+#include "stats.h"
+#include "watch.h"
+
+// prefix of error messages, set with find_set_name
+char const *prog_name = "find";
+
+struct find_ctx
+{
+  struct find_opts opts;
+  struct expr_prog expr;
+  char *root;
+
+  struct walker *walker;  // find_open only
+
+  // find_walk without a callback only, set up as far as opts points to them
+  struct format format;
+  struct dupes dupes;
+  struct du du;
+  struct watcher watcher;
+  int stats;
+};
+
+// matching entries are handed to fn by find_walk
+struct walk_cb
+{
+  int (*fn) (struct find_entry *e, void *arg);
+  void *arg;
+  int stopped;  // fn returned non-zero
+};
+
+// === Setup ===================================================================
+
+// Prefix error messages with name (which has to outlive all traversals)
+// rather than "find", the find command passes argv[0].
+void
+find_set_name (char const *name)
+{
+  prog_name = name;
+}
+
+// set up options for a plain traversal of the whole tree, reporting every
+// entry
+void
+find_options_init (struct find_options *opts)
+{
+  opts->follow = opts->xdev = 0;
+  opts->min_depth = 0;
+  opts->max_depth = -1;
+  opts->n_threads = 1;
+  opts->inode_order = opts->uring = 0;
+  opts->expr = NULL;
+
+  opts->ordered = 0;
+  opts->print0 = 0;
+  opts->format = FIND_FORMAT_TEXT;
+
+  opts->dupes = opts->du = opts->watch = opts->stats = 0;
+}
+
+// run what is left of the batches of -exec ... {} +, wait for all commands
+// and free ctx, returns -1 if any of the commands failed
+static int
+ctx_free (struct find_ctx *ctx)
+{
+  int err = expr_flush (&ctx->expr);
+
+  if (exec_wait () != 0)
+    err = -1;
+
+  if (ctx->opts.format)
+    format_free (&ctx->format);
+
+  if (ctx->opts.watch)
+    watch_free (&ctx->watcher);
+
+  if (ctx->opts.dupes)
+    dupes_free (&ctx->dupes);
+
+  if (ctx->opts.du)
+    du_free (&ctx->du);
+
+  expr_free (&ctx->expr);
+  free (ctx->root);
+  free (ctx);
+
+  return err;
+}
+
+// set up printing, -dupes, -du and -watch as options asks for
+static int
+ctx_output (struct find_ctx *ctx, struct find_options const *options)
+{
+  struct find_opts *opts = &ctx->opts;
+
+  opts->ordered = options->ordered;
+  opts->print0 = options->print0;
+
+  // -printf in the expression prints entries in its format
+  char const *fmt = ctx->expr.format;
+
+  if (fmt && options->format != FIND_FORMAT_TEXT)
+    {
+      fprintf (stderr, "%s: -printf cannot be combined with -format\n",
+               prog_name);
+      return -1;
+    }
+
+  if ((fmt || options->format != FIND_FORMAT_TEXT) && options->dupes)
+    {
+      fprintf (stderr, "%s: -dupes cannot be combined with %s\n", prog_name,
+               fmt ? "-printf" : "-format");
+      return -1;
+    }
+
+  if (fmt || options->format != FIND_FORMAT_TEXT)
+    {
+      enum format_kind kind = FORMAT_PRINTF;
+
+      if (!fmt)
+        kind = options->format == FIND_FORMAT_NDJSON ? FORMAT_NDJSON
+                                                     : FORMAT_BINARY;
+
+      if (format_init (&ctx->format, kind, fmt) != 0)
+        return -1;
+
+      opts->format = &ctx->format;
+    }
+
+  // directories are watched as they are traversed
+  if (options->watch)
+    {
+      if (watch_init (&ctx->watcher) != 0)
+        return -1;
+
+      opts->watch = &ctx->watcher;
+    }
+
+  // matching files are collected and grouped after the traversal
+  if (options->dupes)
+    {
+      if (dupes_init (&ctx->dupes, opts->n_threads) != 0)
+        return -1;
+
+      opts->dupes = &ctx->dupes;
+    }
+
+  // usage is added up for the whole tree, -maxdepth only limits what is
+  // printed
+  if (options->du)
+    {
+      if (du_init (&ctx->du, opts->max_depth) != 0)
+        return -1;
+
+      opts->du = &ctx->du;
+      opts->eval_depth = opts->max_depth;
+      opts->max_depth = INT_MAX;
+    }
+
+  ctx->stats = options->stats;
+
+  return 0;
+}
+
+// Set up a traversal of root, with print set matching entries are printed
+// as options asks for rather than handed out. Returns NULL on errors (after
+// printing a message).
+static struct find_ctx *
+ctx_init (char const *root, struct find_options const *options, int print)
+{
+  struct find_ctx *ctx = calloc (1, sizeof (*ctx));
+  if (!ctx)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  size_t len = strlen (root);
+
+  ctx->root = malloc (len + 1);
+  if (!ctx->root)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      free (ctx);
+      return NULL;
+    }
+
+  strcpy (ctx->root, root);
+
+  if (len > 1 && ctx->root[len - 1] == '/')
+    ctx->root[len - 1] = '\0';
+
+  // determine initial device
+  struct stat sb;
+  if (stat (ctx->root, &sb) == -1)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, ctx->root, strerror (errno));
+      free (ctx->root);
+      free (ctx);
+      return NULL;
+    }
+
+  int argc = 0;
+  while (options->expr && options->expr[argc])
+    ++argc;
+
+  if (expr_compile (&ctx->expr, argc, options->expr) != 0)
+    {
+      free (ctx->root);
+      free (ctx);
+      return NULL;
+    }
+
+  struct find_opts *opts = &ctx->opts;
+
+  opts->expr = &ctx->expr;
+  opts->follow = options->follow;
+  opts->xdev = options->xdev;
+  opts->dev = sb.st_dev;
+  opts->print0 = 0;
+  opts->format = NULL;
+  opts->min_depth = options->min_depth;
+  opts->max_depth = options->max_depth < 0 ? INT_MAX : options->max_depth;
+  opts->eval_depth = INT_MAX;
+  opts->n_threads = options->n_threads < 1 ? 1 : options->n_threads;
+  opts->ordered = 0;
+  opts->inode_order = options->inode_order;
+  opts->uring = options->uring;
+  opts->watch = NULL;
+  opts->dupes = NULL;
+  opts->du = NULL;
+  opts->on_match = NULL;
+  opts->arg = NULL;
+
+  if (print && ctx_output (ctx, options) != 0)
+    {
+      ctx_free (ctx);
+      return NULL;
+    }
+
+  return ctx;
+}
+
+// print what was collected during the traversal of ctx and keep watching the
+// tree if options asked for it, err tells whether the traversal failed
+static int
+ctx_report (struct find_ctx *ctx, int err)
+{
+  struct find_opts const *opts = &ctx->opts;
+  char term = opts->print0 ? '\0' : '\n';
+
+  if (expr_flush (&ctx->expr) != 0 || exec_wait () != 0)
+    err = -1;
+
+  if (ctx->stats)
+    stats_report ();
+
+  if (opts->dupes && err == 0
+      && dupes_report (opts->dupes, STDOUT_FILENO, term) != 0)
+    {
+      err = -1;
+    }
+
+  if (opts->du && err == 0 && du_report (opts->du, STDOUT_FILENO, term) != 0)
+    err = -1;
+
+  if (opts->watch && err == 0)
+    err = watch_run (opts, opts->watch);
+
+  return err;
+}
+
+// === Iterator ================================================================
+
+// Start a traversal of the tree at root, returns NULL on errors (after
+// printing a message).
+struct find_ctx *
+find_open (char const *root, struct find_options const *opts)
+{
+  struct find_ctx *ctx = ctx_init (root, opts, 0);
+  if (!ctx)
+    return NULL;
+
+  ctx->walker = walker_open (&ctx->opts, ctx->root);
+  if (!ctx->walker)
+    {
+      ctx_free (ctx);
+      return NULL;
+    }
+
+  return ctx;
+}
+
+// Store the next entry for which the expression is true in *e, it stays
+// valid (as does find_entry_stat on it) until the next call. The root is
+// reported first, directories before their contents. Returns 1 if there is
+// an entry, 0 once the traversal is done and -1 on errors.
+int
+find_next (struct find_ctx *ctx, struct find_entry **e)
+{
+  struct entry *next;
+
+  int ret = walker_next (ctx->walker, &next);
+  if (ret == 1)
+    *e = (struct find_entry *) next;
+
+  return ret;
+}
+
+// do not descend into the directory returned last by find_next
+void
+find_prune (struct find_ctx *ctx)
+{
+  walker_prune (ctx->walker);
+}
+
+// end the traversal, returns -1 if a command run by -exec failed
+int
+find_close (struct find_ctx *ctx)
+{
+  walker_close (ctx->walker);
+
+  return ctx_free (ctx);
+}
+
+// === Callback ================================================================
+
+static int
+call_fn (struct entry *e, void *arg)
+{
+  struct walk_cb *cb = arg;
+
+  if (cb->fn ((struct find_entry *) e, cb->arg) == 0)
+    return 0;
+
+  __atomic_store_n (&cb->stopped, 1, __ATOMIC_SEQ_CST);
+
+  return -1;
+}
+
+// Traverse the tree at root and call fn for every entry for which the
+// expression is true, fn may prune a directory with find_entry_prune and
+// returns non-zero to stop the traversal. With more than one thread, fn is
+// called from all of them at once and in no particular order. Without fn,
+// entries are printed instead and whatever else opts asks for is done
+// afterwards. Returns 0 once the whole tree was traversed, 1 if fn stopped it
+// and -1 on errors.
+int
+find_walk (char const *root, struct find_options const *opts,
+           int (*fn) (struct find_entry *e, void *arg), void *arg)
+{
+  struct find_ctx *ctx = ctx_init (root, opts, !fn);
+  if (!ctx)
+    return -1;
+
+  struct walk_cb cb = { fn, arg, 0 };
+
+  if (fn)
+    {
+      ctx->opts.on_match = call_fn;
+      ctx->opts.arg = &cb;
+    }
+
+  if (ctx->stats)
+    stats_start ();
+
+  int err;
+  if (ctx->opts.n_threads > 1)
+    err = find_par (&ctx->opts, ctx->root);
+  else
+    err = find_seq (&ctx->opts, ctx->root);
+
+  if (!fn)
+    err = ctx_report (ctx, err);
+
+  if (ctx_free (ctx) != 0)
+    err = -1;
+
+  if (cb.stopped)
+    return 1;
+
+  return err == 0 ? 0 : -1;
+}
+
+// === Entries =================================================================
+
+char const *
+find_entry_name (struct find_entry const *e)
+{
+  return ((struct entry const *) e)->name;
+}
+
+char const *
+find_entry_path (struct find_entry const *e)
+{
+  return ((struct entry const *) e)->path;
+}
+
+// DT_* type of the entry, after following symlinks if opts->follow is set
+unsigned char
+find_entry_type (struct find_entry const *e)
+{
+  return ((struct entry const *) e)->type;
+}
+
+// Fill sb with the stat data of the entry, which is fetched on the first call
+// only. Sets errno and returns -1 on errors.
+int
+find_entry_stat (struct find_entry *e, struct stat *sb)
+{
+  struct entry *ent = (struct entry *) e;
+
+  if (entry_stat (ent, STATX_BASIC_STATS) != 0)
+    return -1;
+
+  struct linux_statx const *stx = &ent->stx;
+
+  memset (sb, 0, sizeof (*sb));
+
+  sb->st_dev = xstat_dev (stx);
+  sb->st_ino = stx->stx_ino;
+  sb->st_mode = stx->stx_mode;
+  sb->st_nlink = stx->stx_nlink;
+  sb->st_uid = stx->stx_uid;
+  sb->st_gid = stx->stx_gid;
+  sb->st_rdev = makedev (stx->stx_rdev_major, stx->stx_rdev_minor);
+  sb->st_size = stx->stx_size;
+  sb->st_blksize = stx->stx_blksize;
+  sb->st_blocks = stx->stx_blocks;
+  sb->st_atim.tv_sec = stx->stx_atime.tv_sec;
+  sb->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+  sb->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+  sb->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+  sb->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+  sb->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+
+  return 0;
+}
+
+// from a find_walk callback, do not descend into the directory e
+void
+find_entry_prune (struct find_entry *e)
+{
+  ((struct entry *) e)->prune = 1;
+}
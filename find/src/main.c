@@ -1,27 +1,100 @@
-#include <dirent.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <fnmatch.h>
-#include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <unistd.h>
 
-#define USAGE_MSG "Usage: %s <directory name> [-name <pattern>] [-type <f | d>] [-follow] [-xdev]\n"
+#include "exec.h"
+#include "expr.h"
+#include "find.h"
+#include "format.h"
+#include "index.h"
+#include "libfind.h"
 
-#define HELP_MSG "Recursively print files in directory <directory name>.\n\n" \
-                 "  -name <pattern>  only consider files matching <pattern>\n" \
-                 "  -type <f|d>      only consider regular files (f) / directories (d)\n" \
-                 "  -follow          follow symbolic links\n" \
-                 "  -xdev            do not cross file system boundaries\n"
-
-#define INO_HASH_SZ 100
+#define USAGE_MSG "Usage: %s <directory name> [-follow] [-xdev] [-print0] [-format <text|ndjson|binary>] [-maxdepth <n>] [-mindepth <n>] [-j <n> [-ordered]] [-inode-order] [-uring] [-P <n>] [-watch] [-dupes] [-du] [-stats] [expression]\n" \
+                  "       %s -index-build <directory name> <index file> [-xdev]\n" \
+                  "       %s -index-query <index file> [-print0] [expression]\n"
 
-static char *prog_name;
+#define HELP_MSG "Recursively print files in directory <directory name> for which\n" \
+                 "<expression> is true.\n\n" \
+                 "Options:\n" \
+                 "  -follow          follow symbolic links\n" \
+                 "  -xdev            do not cross file system boundaries\n" \
+                 "  -print0          separate file names by NUL instead of newline\n" \
+                 "  -format <text|ndjson|binary>\n" \
+                 "                   print plain names, a JSON object per line or\n" \
+                 "                   length-prefixed binary records, the latter two\n" \
+                 "                   carrying path, type, size, mtime, inode and device\n" \
+                 "  -maxdepth <n>    descend at most <n> levels below the directory\n" \
+                 "  -mindepth <n>    do not apply <expression> to files less than <n>\n" \
+                 "                   levels below the directory\n" \
+                 "  -j <n>           traverse directories using <n> threads\n" \
+                 "  -ordered         with -j, print files in sequential traversal order\n" \
+                 "  -inode-order     read each directory in full and stat its files in\n" \
+                 "                   inode order before traversing it (faster on\n" \
+                 "                   rotating disks)\n" \
+                 "  -uring           read each directory in full and stat its files\n" \
+                 "                   through io_uring before traversing it, keeping\n" \
+                 "                   many requests in flight\n" \
+                 "  -P <n>           run up to <n> commands of -exec ... {} + at once\n" \
+                 "  -watch           after the traversal, keep printing files for which\n" \
+                 "                   <expression> is true as they are created, written\n" \
+                 "                   or moved into the tree\n" \
+                 "  -dupes           print groups of files with identical content\n" \
+                 "                   (separated by empty lines) instead of the files\n" \
+                 "                   for which <expression> is true\n" \
+                 "  -du              after the files, print the apparent and allocated\n" \
+                 "                   size of each directory, with -maxdepth <n> the\n" \
+                 "                   whole tree is counted but files and directories\n" \
+                 "                   are only printed down to <n> levels\n" \
+                 "  -stats           after the traversal, print counts of directories,\n" \
+                 "                   files and system calls and the time spent per\n" \
+                 "                   phase to stderr\n\n" \
+                 "Index:\n" \
+                 "  -index-build <directory name> <index file>\n" \
+                 "                   write the paths below <directory name> to\n" \
+                 "                   <index file>, if it already holds an index of that\n" \
+                 "                   directory only modified directories are read again\n" \
+                 "  -index-query <index file>\n" \
+                 "                   print indexed files for which <expression> is true,\n" \
+                 "                   only -name, -name-from, -type and -grep can be used\n\n" \
+                 "Expressions:\n" \
+                 "  ( <expr> )       grouping\n" \
+                 "  ! <expr>, -not <expr>\n" \
+                 "  <expr> [-a] <expr>, <expr> -and <expr>\n" \
+                 "  <expr> -o <expr>, <expr> -or <expr>\n\n" \
+                 "  -name <pattern>  file name matches <pattern>\n" \
+                 "  -name-from <file>\n" \
+                 "                   file name matches any of the patterns listed in\n" \
+                 "                   <file>, one per line\n" \
+                 "  -type <f|d|l|b|c|p|s>\n" \
+                 "                   file is of the given type\n" \
+                 "  -size [+-]<n>[cwbkMG]\n" \
+                 "                   file uses more/less/exactly <n> units of space\n" \
+                 "  -mtime [+-]<n>   file was last modified more/less/exactly <n> days ago\n" \
+                 "  -newer <file>    file was modified more recently than <file>\n" \
+                 "  -perm [-/]<mode> file permissions are exactly/at least/any of octal\n" \
+                 "                   <mode>\n" \
+                 "  -user <name>     file is owned by user <name> (or numeric user ID)\n" \
+                 "  -grep <string>   file is a regular file containing <string>\n\n" \
+                 "  -prune           true, do not descend into the directory\n" \
+                 "  -print           true, print the file name (if <expression> contains\n" \
+                 "                   -print, -printf or -exec, files are not printed\n" \
+                 "                   otherwise)\n" \
+                 "  -printf <format> true, print <format> for the file instead of its\n" \
+                 "                   name, with the escapes \\n, \\t, \\r, \\0 and \\\\\n" \
+                 "                   and the fields %%p (path), %%f (name), %%y (type),\n" \
+                 "                   %%s (size), %%m (octal permissions), %%n (links),\n" \
+                 "                   %%i (inode), %%D (device), %%T@ (mtime in seconds)\n" \
+                 "                   and %%%% (only once, not together with -print)\n" \
+                 "  -exec <command> ;\n" \
+                 "                   run <command> with every {} replaced by the file\n" \
+                 "                   name, true if it exits successfully\n" \
+                 "  -exec <command> {} +\n" \
+                 "                   true, run <command> with as many file names\n" \
+                 "                   appended as fit on a command line\n"
 
 static void
 usage (int status)
@@ -30,512 +103,385 @@ usage (int status)
     fprintf (stderr, "Try '%s --help' for more information.\n", prog_name);
   else
     {
-      printf (USAGE_MSG, prog_name);
+      printf (USAGE_MSG, prog_name, prog_name, prog_name);
       printf (HELP_MSG);
     }
 }
 
-// === Inode graph functions ===================================================
-
-static struct ino_node
+// Parse the numeric argument of option opt (given without dashes), returns
+// -1 if it is missing or not within [min, max].
+static long
+parse_count (char const *opt, char const *arg, long min, long max)
 {
-  dev_t dev;
-  ino_t ino;
-  char *path;
-
-  int n_children;
-  struct ino_node **children;
-
-  struct ino_node *next;
-
-} *ino_hash[INO_HASH_SZ];
+  char *endptr;
+  long n = -1;
 
-static void
-ino_hash_alloc (void)
-{
-  for (int i = 0; i < INO_HASH_SZ; ++i)
-    ino_hash[i] = NULL;
-}
-
-static void
-ino_hash_free (void)
-{
-  for (int i = 0; i < INO_HASH_SZ; ++i)
+  if (arg)
     {
-      struct ino_node *head, *last;
-
-      head = ino_hash[i];
-
-      while (head)
-        {
-          last = head;
-          head = head->next;
+      errno = 0;
+      n = strtol (arg, &endptr, 10);
 
-          free (last->path);
-          free (last->children);
-          free (last);
-        }
+      if (errno != 0 || *endptr != '\0' || endptr == arg)
+        n = -1;
     }
-}
 
-static int
-label_ino_node (struct ino_node *node, char *path)
-{
-  node->path = malloc (strlen (path) + 1);
-  if (!node->path)
-    return -1;
-
-  strcpy (node->path, path);
+  if (n < min || n > max)
+    {
+      fprintf (stderr, "%s: argument to '%s' should be a number between %ld "
+                       "and %ld\n", prog_name, opt, min, max);
+      return -1;
+    }
 
-  return 0;
+  return n;
 }
 
-static struct ino_node *
-create_ino_node (dev_t dev, ino_t ino)
+// Determine the output format from the argument of -format (NULL if not
+// given), returns -1 on errors.
+static int
+output_format (struct find_options *opts, char const *name)
 {
-  ino_t idx = ino % INO_HASH_SZ;
-
-  struct ino_node *tmp = malloc (sizeof (*tmp));
-  if (!tmp)
+  if (!name || strcmp (name, "text") == 0)
+    opts->format = FIND_FORMAT_TEXT;
+  else if (strcmp (name, "ndjson") == 0)
+    opts->format = FIND_FORMAT_NDJSON;
+  else if (strcmp (name, "binary") == 0)
+    opts->format = FIND_FORMAT_BINARY;
+  else
     {
-      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
-      return NULL;
+      fprintf (stderr, "%s: argument to 'format' should be one of 'text', "
+                       "'ndjson' or 'binary'\n", prog_name);
+      return -1;
     }
 
-  tmp->dev = dev;
-  tmp->ino = ino;
-
-  tmp->n_children = 0;
-  tmp->children = NULL;
-
-  if (ino_hash[idx])
-    tmp->next = ino_hash[idx];
-  else
-    tmp->next = NULL;
-
-  ino_hash[idx] = tmp;
-
-  return tmp;
+  return 0;
 }
 
-static struct ino_node *
-get_ino_node (dev_t dev, ino_t ino)
+// run what is left of the batches of -exec ... {} + and wait for all
+// commands, returns -1 if any of them failed
+static int
+finish_exec (struct expr_prog const *expr)
 {
-  ino_t idx = ino % INO_HASH_SZ;
-
-  struct ino_node *head = ino_hash[idx];
-  while (head)
-    {
-      if (head->dev == dev && head->ino == ino)
-        return head;
+  int err = expr_flush (expr);
 
-      head = head->next;
-    }
+  if (exec_wait () != 0)
+    err = -1;
 
-  return NULL;
+  return err;
 }
 
+// Write the paths below dir to the index file, or with dir NULL print the
+// indexed files for which the expression is true, returns -1 on errors.
+// The index only knows names and types, so this runs without libfind.
 static int
-extend_graph (dev_t source_dev, ino_t source_ino,
-              dev_t target_dev, ino_t target_ino, char *target_path)
+run_index (struct find_options const *options, char *dir, char const *file,
+           int expr_argc, char **expr_argv)
 {
-  struct ino_node *source_node = get_ino_node (source_dev, source_ino);
-  if (!source_node)
-    {
-      source_node = create_ino_node (source_dev, source_ino);
-      if (!source_node)
-        return -1;
-    }
+  struct expr_prog expr;
 
-  struct ino_node *target_node = get_ino_node (target_dev, target_ino);
-  if (!target_node)
-    {
-      target_node = create_ino_node (target_dev, target_ino);
-      if (!target_node)
-        return -1;
+  if (expr_compile (&expr, expr_argc, expr_argv) != 0)
+    return -1;
 
-      label_ino_node (target_node, target_path);
-    }
+  struct find_opts opts = { 0 };
 
-  for (int i = 0; i < source_node->n_children; ++i)
-    {
-      if (source_node->children[i]->dev == target_dev
-          && source_node->children[i]->ino == target_ino)
-        {
-          return 0;
-        }
-    }
-
-  ++source_node->n_children;
+  opts.expr = &expr;
+  opts.follow = options->follow;
+  opts.xdev = options->xdev;
+  opts.print0 = options->print0;
+  opts.min_depth = options->min_depth;
+  opts.max_depth = options->max_depth < 0 ? INT_MAX : options->max_depth;
+  opts.eval_depth = INT_MAX;
+  opts.n_threads = options->n_threads;
 
-  struct ino_node **tmp = realloc (
-    source_node->children,
-    source_node->n_children * sizeof (struct ino_node **));
+  struct format format = { 0 };
+  int err = -1;
 
-  if (!tmp)
+  if (expr.format && options->format != FIND_FORMAT_TEXT)
     {
-      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
-      return -1;
+      fprintf (stderr, "%s: -printf cannot be combined with -format\n",
+               prog_name);
+      goto cleanup;
     }
 
-  source_node->children = tmp;
-  source_node->children[source_node->n_children - 1] = target_node;
-
-  return 0;
-}
-
-static int
-_is_parent (struct ino_node *head, dev_t dev, ino_t ino)
-{
-  if (head->dev == dev && head->ino == ino)
-    return 1;
-
-  for (int i = 0; i < head->n_children; ++i)
+  if (expr.format || options->format != FIND_FORMAT_TEXT)
     {
-      if (_is_parent (head->children[i], dev, ino))
-        return 1;
-    }
-
-  return 0;
-}
-
-static int
-is_parent (dev_t head_dev, ino_t head_ino, dev_t dev, ino_t ino)
-{
-  ino_t idx = head_ino % INO_HASH_SZ;
+      enum format_kind kind = FORMAT_PRINTF;
 
-  struct ino_node *head_node = ino_hash[idx];
-  if (!head_node)
-    return 0;
+      if (!expr.format)
+        kind = options->format == FIND_FORMAT_NDJSON ? FORMAT_NDJSON
+                                                     : FORMAT_BINARY;
 
-  while (head_node)
-    {
-      if (head_node->dev == head_dev && head_node->ino == head_ino)
-        return _is_parent (head_node, dev, ino);
+      if (format_init (&format, kind, expr.format) != 0)
+        goto cleanup;
 
-      head_node = head_node->next;
+      opts.format = &format;
     }
 
-  return 0;
-}
-
-// === Other utility functions =================================================
-
-static int
-matches (char *pattern, char *file)
-{
-  int match = 0;
-  if (pattern)
+  if (!dir)
     {
-      switch (fnmatch (pattern, file, 0))
+      if (expr_needs_stat (&expr))
         {
-        case 0:
-          match = 1;
-          break;
-        case FNM_NOMATCH:
-          break;
-        default:
-          fprintf (stderr, "%s: fnmatch failed\n", prog_name);
-          exit (EXIT_FAILURE);
+          fprintf (stderr, "%s: only -name, -name-from, -type and -grep can "
+                           "be used with -index-query\n", prog_name);
+          goto cleanup;
         }
-    }
-  else
-    match = 1;
 
-  return match;
-}
-
-static int
-ignore (char *file, struct stat *sb, struct stat *lsb,
-        char *pattern, int f, int d, int follow)
-{
-  if (!matches (pattern, file))
-    return 1;
-
-  if (f == 1 && d == 0)
-    {
-      if (!S_ISREG (lsb->st_mode))
+      if (format.stat_mask != 0)
         {
-          if (!follow)
-            return 1;
-          else
-            {
-              if (!S_ISLNK (lsb->st_mode) || !(sb && S_ISREG (sb->st_mode)))
-                return 1;
-            }
+          fprintf (stderr, "%s: only the -printf fields %%p, %%f and %%y can "
+                           "be used with -index-query\n", prog_name);
+          goto cleanup;
         }
+
+      err = index_query (&opts, file);
     }
-  else if (f == 0 && d == 1)
+  else
     {
-      if (!S_ISDIR (lsb->st_mode))
+      if (expr.n_insns > 0 || opts.follow)
         {
-          if (!follow)
-            return 1;
-          else
-            {
-              if (!S_ISLNK (lsb->st_mode) || !(sb && S_ISDIR (sb->st_mode)))
-                return 1;
-            }
+          fprintf (stderr, "%s: -index-build does not take an expression or "
+                           "-follow\n", prog_name);
+          goto cleanup;
         }
-    }
-
-  return 0;
-}
 
-// === Main find function ======================================================
+      // pre-process directory argument
+      if (strlen (dir) > 1 && dir[strlen (dir) - 1] == '/')
+        dir[strlen (dir) - 1] = '\0';
 
-static int
-find (char *file, char *path, char *pattern, int f, int d, int follow,
-      int xdev, dev_t dev, dev_t parent_dev, ino_t parent_ino, int parent_fd)
-{
-  // stat current file
-  struct stat sb, lsb;
-  struct stat *sb_ptr = NULL;
+      // determine initial device
+      struct stat sb;
+      if (stat (dir, &sb) == -1)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          goto cleanup;
+        }
 
-  if (parent_fd == AT_FDCWD)
-    {
-      if (lstat (file, &lsb) == -1)
-        return 0;
+      opts.dev = sb.st_dev;
 
-      if (stat (file, &sb) != -1)
-        sb_ptr = &sb;
+      err = index_build (&opts, dir, file);
     }
-  else
-    {
-      if (fstatat (parent_fd, file, &lsb, AT_SYMLINK_NOFOLLOW) == -1)
-        return 0;
 
-      if (fstatat (parent_fd, file, &sb, 0) != -1)
-        sb_ptr = &sb;
-    }
+  if (finish_exec (&expr) != 0)
+    err = -1;
 
-  // check for file system loops
-  if (follow && sb_ptr)
-    {
-      if (parent_ino != 0)
-        {
-          if (is_parent (sb.st_dev, sb.st_ino, parent_dev, parent_ino))
-            {
-              struct ino_node *parent_node = get_ino_node (parent_dev,
-                                                           parent_ino);
+cleanup:
+  expr_free (&expr);
+  format_free (&format);
 
-              fprintf (stderr,
-                       "%s: File system loop detected; "
-                       "‘%s’ is part of the same file system loop as ‘%s’.\n",
-                       prog_name, path, parent_node->path);
+  return err;
+}
 
-              return 0;
-            }
+// === Main ====================================================================
 
-          int err = extend_graph (parent_dev, parent_ino,
-                                  sb.st_dev, sb.st_ino, path);
-          if (err != 0)
-            return 1;
-        }
-      else
-        {
-          struct ino_node *root = create_ino_node (sb.st_dev, sb.st_ino);
-          label_ino_node (root, path);
-        }
-    }
+int
+main (int argc, char **argv)
+{
+  // remember program name
+  find_set_name (argv[0]);
 
-  // print name of matching files
-  if (!ignore (file, sb_ptr, &lsb, pattern, f, d, follow))
-    printf ("%s\n", path);
+  // parse arguments, options may appear anywhere, expression tokens are
+  // collected in order
+  struct find_options opts;
 
-  // stop recursion for non-directories
-  if (!follow)
-    {
-      if (!S_ISDIR (lsb.st_mode))
-        return 0;
-    }
-  else
-    {
-      if (!S_ISDIR (lsb.st_mode)
-          && !(S_ISLNK (lsb.st_mode) && sb_ptr && S_ISDIR (sb.st_mode)))
-        return 0;
-    }
+  find_options_init (&opts);
 
-  // stop at file system boundaries when -xdev is set
-  if (xdev && sb.st_dev != dev)
-    return 0;
+  // -format argument
+  char *format_name = NULL;
 
-  // obtain directory fp (for calls to fstatat)
-  int dirfd;
-  if (parent_fd == AT_FDCWD)
-    {
-      if ((dirfd = open (path, O_RDONLY)) == -1)
-        return 0;
-    }
-  else
-    {
-      if ((dirfd = openat (parent_fd, file, O_RDONLY)) == -1)
-        return 0;
-    }
+  char *file = NULL;
+  int n_files = 0;
 
-  // read directory
-  DIR *dird = fdopendir (dirfd);
-  if (!dird)
+  // -index-build / -index-query arguments
+  enum { INDEX_NONE, INDEX_BUILD, INDEX_QUERY } index_mode = INDEX_NONE;
+  char *index_dir = NULL, *index_file = NULL;
+
+  // room for the terminating NULL
+  char **expr_argv = malloc (argc * sizeof (*expr_argv));
+  if (!expr_argv)
     {
       fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
-      return 1;
+      exit (EXIT_FAILURE);
     }
 
-  // iterate through directory entries
-  int err = 0;
+  int expr_argc = 0;
 
-  for (;;)
+  for (int i = 1; i < argc; ++i)
     {
-      errno = 0;
-      struct dirent *dirent = readdir (dird);
+      char *arg = argv[i];
 
-      if (!dirent)
-        {
-          closedir (dird);
+      // accept --option as well
+      if (arg[0] == '-' && arg[1] == '-' && arg[2] != '\0')
+        ++arg;
 
-          if (errno == 0)
-            return 0;
+      if (strcmp (arg, "-h") == 0 || strcmp (arg, "-help") == 0)
+        {
+          usage (EXIT_SUCCESS);
+          free (expr_argv);
+          exit (EXIT_SUCCESS);
+        }
+      else if (strcmp (arg, "-follow") == 0)
+        opts.follow = 1;
+      else if (strcmp (arg, "-xdev") == 0)
+        opts.xdev = 1;
+      else if (strcmp (arg, "-print0") == 0)
+        opts.print0 = 1;
+      else if (strcmp (arg, "-format") == 0)
+        {
+          if (i + 1 >= argc)
+            {
+              fprintf (stderr, "%s: %s expects an argument\n", prog_name,
+                       argv[i]);
+              usage (EXIT_FAILURE);
+              free (expr_argv);
+              exit (EXIT_FAILURE);
+            }
 
-          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
-          return 1;
+          format_name = argv[++i];
         }
+      else if (strncmp (arg, "-format=", 8) == 0)
+        format_name = arg + 8;
+      else if (strcmp (arg, "-ordered") == 0)
+        opts.ordered = 1;
+      else if (strcmp (arg, "-inode-order") == 0)
+        opts.inode_order = 1;
+      else if (strcmp (arg, "-uring") == 0)
+        opts.uring = 1;
+      else if (strcmp (arg, "-watch") == 0)
+        opts.watch = 1;
+      else if (strcmp (arg, "-dupes") == 0)
+        opts.dupes = 1;
+      else if (strcmp (arg, "-du") == 0)
+        opts.du = 1;
+      else if (strcmp (arg, "-stats") == 0)
+        opts.stats = 1;
+      else if (strcmp (arg, "-P") == 0)
+        {
+          long n = parse_count ("P", i + 1 < argc ? argv[++i] : NULL, 1, 1024);
+          if (n == -1)
+            {
+              free (expr_argv);
+              exit (EXIT_FAILURE);
+            }
 
-      // ignore . and ..
-      int is_dot = (strcmp (dirent->d_name, ".") == 0);
-      int is_dotdot = (strcmp (dirent->d_name, "..") == 0);
+          exec_set_procs (n);
+        }
+      else if (strcmp (arg, "-j") == 0 || strcmp (arg, "-maxdepth") == 0
+               || strcmp (arg, "-mindepth") == 0)
+        {
+          int threads = (arg[1] == 'j');
 
-      if (is_dot || is_dotdot)
-        continue;
+          long n = parse_count (arg + 1, i + 1 < argc ? argv[++i] : NULL,
+                                threads ? 1 : 0, threads ? 1024 : INT_MAX);
+          if (n == -1)
+            {
+              free (expr_argv);
+              exit (EXIT_FAILURE);
+            }
 
-      // extend pathname
-      char *next_path = malloc(strlen(path) + strlen(dirent->d_name) + 2);
-      if (!next_path)
-        {
-          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
-          return 1;
+          if (threads)
+            opts.n_threads = n;
+          else if (arg[2] == 'a')
+            opts.max_depth = n;
+          else
+            opts.min_depth = n;
         }
+      else if (strcmp (arg, "-index-build") == 0
+               || strcmp (arg, "-index-query") == 0)
+        {
+          int build = (arg[7] == 'b');
+          int n_args = build ? 2 : 1;
 
-      sprintf (next_path, "%s/%s", path, dirent->d_name);
+          if (index_mode != INDEX_NONE || i + n_args >= argc)
+            {
+              fprintf (stderr, "%s: %s expects %s\n", prog_name, argv[i],
+                       build ? "a directory and an index file"
+                             : "an index file");
+              usage (EXIT_FAILURE);
+              free (expr_argv);
+              exit (EXIT_FAILURE);
+            }
 
-      // recurse
-      err |= find (dirent->d_name, next_path, pattern, f, d, follow,
-                   xdev, dev, sb.st_dev, sb.st_ino, dirfd);
+          index_mode = build ? INDEX_BUILD : INDEX_QUERY;
 
-      // free resources
-      free (next_path);
+          if (build)
+            index_dir = argv[++i];
 
-      if (err == 1)
-        {
-          close (dirfd);
-          closedir (dird);
-          return 1;
+          index_file = argv[++i];
         }
-    }
-
-  close (dirfd);
-  closedir (dird);
-  return 0;
-}
+      else if (expr_arity (arg, argc - i - 1, argv + i + 1) >= 0)
+        {
+          expr_argv[expr_argc++] = arg;
 
-// === Main ====================================================================
+          // arguments of primaries are taken verbatim
+          int n = expr_arity (arg, argc - i - 1, argv + i + 1);
 
-int
-main (int argc, char **argv)
-{
-  // remember program name
-  prog_name = argv[0];
-
-  // parse arguments
-  static struct option const long_options[] =
-  {
-    {"follow", no_argument, NULL, 'f'},
-    {"help", no_argument, NULL, 'h'},
-    {"name", required_argument, NULL, 'n'},
-    {"type", required_argument, NULL, 't'},
-    {"xdev", no_argument, NULL, 'x'},
-    {NULL, 0, NULL, 0}
-  };
-
-  char *pattern;
-  int f, d, follow, xdev;
-
-  pattern = NULL;
-  f = d = 1;
-  follow = xdev = 0;
-
-  int c;
-  while ((c = getopt_long_only (argc, argv, "h", long_options, NULL)) != -1)
-    {
-      switch (c)
+          for (; n > 0 && i + 1 < argc; --n)
+            expr_argv[expr_argc++] = argv[++i];
+        }
+      else if (arg[0] == '-' && arg[1] != '\0')
         {
-        case 'f':
-          follow = 1;
-          break;
-        case 'h':
-          usage (EXIT_SUCCESS);
-          free (pattern);
-          exit (EXIT_SUCCESS);
-        case 'n':
-          pattern = malloc (strlen (optarg) + 1);
-          strcpy (pattern, optarg);
-          break;
-        case 't':
-          if (strcmp (optarg, "f") == 0)
-            d = 0;
-          else if (strcmp (optarg, "d") == 0)
-            f = 0;
-          else
-            {
-              fprintf (stderr, "%s: argument to 'type' should be 'f' or 'd'\n",
-                       prog_name);
-              free (pattern);
-              exit (EXIT_FAILURE);
-            }
-          break;
-        case 'x':
-          xdev = 1;
-          break;
-        default:
-          free (pattern);
+          fprintf (stderr, "%s: unknown option '%s'\n", prog_name, argv[i]);
+          usage (EXIT_FAILURE);
+          free (expr_argv);
           exit (EXIT_FAILURE);
         }
+      else if (n_files++ == 0)
+        file = argv[i];
+    }
+
+  if (index_mode != INDEX_NONE
+      && (n_files > 0 || opts.watch || opts.dupes || opts.du))
+    {
+      fprintf (stderr, "%s: unexpected argument '%s'\n", prog_name,
+               n_files > 0 ? file
+                           : opts.watch ? "-watch"
+                                        : opts.dupes ? "-dupes" : "-du");
+
+      usage (EXIT_FAILURE);
+      free (expr_argv);
+      exit (EXIT_FAILURE);
     }
+  else if (opts.watch && (opts.dupes || opts.du))
+    {
+      fprintf (stderr, "%s: %s cannot be combined with -watch\n",
+               prog_name, opts.dupes ? "-dupes" : "-du");
 
-  if (!argv[optind] || argv[optind + 1])
+      usage (EXIT_FAILURE);
+      free (expr_argv);
+      exit (EXIT_FAILURE);
+    }
+  else if (index_mode == INDEX_NONE && n_files != 1)
     {
       fprintf (stderr, "%s: should receive single mandatory directory argument\n",
                prog_name);
 
       usage (EXIT_FAILURE);
+      free (expr_argv);
       exit (EXIT_FAILURE);
     }
 
-  // pre-process file argument
-  char *file = argv[optind];
-
-  if (file[strlen (file) - 1] == '/')
-    file[strlen (file) - 1] = '\0';
+  // matching files are printed in the format given by -format (or by
+  // -printf, which is part of the expression)
+  int err = output_format (&opts, format_name);
 
-  // determine initial device
-  struct stat sb;
-  if (stat (file, &sb) == -1)
+  if (err != 0)
     {
-      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
-      free (pattern);
+      usage (EXIT_FAILURE);
+      free (expr_argv);
       exit (EXIT_FAILURE);
     }
 
-  dev_t dev = sb.st_dev;
-
-  // allocate inode hash table / graph
-  ino_hash_alloc ();
+  expr_argv[expr_argc] = NULL;
+  opts.expr = expr_argv;
 
   // perform find
-  int err = find (file, file, pattern, f, d, follow, xdev, dev, 0, 0, AT_FDCWD);
+  if (index_mode != INDEX_NONE)
+    err = run_index (&opts, index_mode == INDEX_BUILD ? index_dir : NULL,
+                     index_file, expr_argc, expr_argv);
+  else
+    err = find_walk (file, &opts, NULL, NULL);
 
   // free resources and exit
-  free (pattern);
-  ino_hash_free ();
+  free (expr_argv);
 
   if (err == 0)
     exit (EXIT_SUCCESS);
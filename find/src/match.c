@@ -0,0 +1,555 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find.h"
+#include "match.h"
+
+// A pattern is first split into tokens, each of which is either a star or a
+// set of bytes matched by a single character ('?', '[...]' or a literal).
+// Patterns made up of literals and stars at the ends only are matched with
+// plain string functions, everything else is compiled into a DFA by subset
+// construction over the token positions. Constructs whose exact fnmatch
+// semantics are not reproduced here ([=a=], [.a.], malformed brackets and
+// escapes) fall back to fnmatch.
+
+#define DFA_MAX_STATES 4096
+
+struct glob_tok
+{
+  int star;
+  unsigned char set[32];
+};
+
+// === Tokenizer ===============================================================
+
+static void
+set_add (unsigned char *set, unsigned char c)
+{
+  set[c >> 3] |= 1 << (c & 7);
+}
+
+static int
+set_has (unsigned char const *set, unsigned char c)
+{
+  return set[c >> 3] & (1 << (c & 7));
+}
+
+// returns the only character in the set or -1
+static int
+set_single (unsigned char const *set)
+{
+  int c = -1;
+
+  for (int i = 0; i < 256; ++i)
+    {
+      if (set_has (set, i))
+        {
+          if (c != -1)
+            return -1;
+
+          c = i;
+        }
+    }
+
+  return c;
+}
+
+static int
+add_class (unsigned char *set, char const *name, size_t len)
+{
+  static struct
+  {
+    char const *name;
+    int (*fn) (int);
+  } const classes[] =
+  {
+    {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+    {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+    {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+    {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit}
+  };
+
+  for (size_t i = 0; i < sizeof (classes) / sizeof (classes[0]); ++i)
+    {
+      if (strlen (classes[i].name) == len
+          && strncmp (classes[i].name, name, len) == 0)
+        {
+          for (int c = 1; c < 256; ++c)
+            {
+              if (classes[i].fn (c))
+                set_add (set, c);
+            }
+
+          return 0;
+        }
+    }
+
+  return -1;
+}
+
+// Parse a bracket expression, p points behind the opening '['. Returns a
+// pointer behind the closing ']' or NULL if the expression is unsupported.
+static char const *
+parse_bracket (char const *p, unsigned char *set)
+{
+  int negate = 0;
+  if (*p == '!' || *p == '^')
+    {
+      negate = 1;
+      ++p;
+    }
+
+  unsigned char tmp[32];
+  memset (tmp, 0, sizeof (tmp));
+
+  for (int first = 1;; first = 0)
+    {
+      if (*p == '\0')
+        return NULL;
+
+      if (*p == ']' && !first)
+        {
+          ++p;
+          break;
+        }
+
+      if (*p == '[' && p[1] == ':')
+        {
+          char const *end = strstr (p + 2, ":]");
+          if (!end || add_class (tmp, p + 2, end - (p + 2)) != 0)
+            return NULL;
+
+          p = end + 2;
+          continue;
+        }
+
+      if (*p == '[' && (p[1] == '=' || p[1] == '.'))
+        return NULL;
+
+      if (*p == '\\' && *++p == '\0')
+        return NULL;
+
+      unsigned char lo = *p++;
+      unsigned char hi = lo;
+
+      if (*p == '-' && p[1] != ']' && p[1] != '\0')
+        {
+          ++p;
+
+          if (*p == '[')
+            return NULL;
+
+          if (*p == '\\' && *++p == '\0')
+            return NULL;
+
+          hi = *p++;
+          if (hi < lo)
+            return NULL;
+        }
+
+      for (int c = lo; c <= hi; ++c)
+        set_add (tmp, c);
+    }
+
+  for (int i = 0; i < 32; ++i)
+    set[i] = negate ? ~tmp[i] : tmp[i];
+
+  return p;
+}
+
+// Returns 0 on success, 1 if the pattern is unsupported and -1 on errors.
+static int
+tokenize (char const *pattern, struct glob_tok **toks, int *n_toks)
+{
+  struct glob_tok *tmp = malloc ((strlen (pattern) + 1) * sizeof (*tmp));
+  if (!tmp)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  int n = 0;
+
+  for (char const *p = pattern; *p;)
+    {
+      struct glob_tok *tok = &tmp[n];
+
+      tok->star = 0;
+      memset (tok->set, 0, sizeof (tok->set));
+
+      switch (*p)
+        {
+        case '*':
+          ++p;
+
+          // consecutive stars are equivalent to a single one
+          if (n > 0 && tmp[n - 1].star)
+            continue;
+
+          tok->star = 1;
+          break;
+        case '?':
+          ++p;
+          memset (tok->set, 0xff, sizeof (tok->set));
+          break;
+        case '[':
+          if (!(p = parse_bracket (p + 1, tok->set)))
+            {
+              free (tmp);
+              return 1;
+            }
+          break;
+        case '\\':
+          if (*++p == '\0')
+            {
+              free (tmp);
+              return 1;
+            }
+          /* fall through */
+        default:
+          set_add (tok->set, *p++);
+          break;
+        }
+
+      ++n;
+    }
+
+  *toks = tmp;
+  *n_toks = n;
+
+  return 0;
+}
+
+// === DFA construction ========================================================
+
+// state sets are bitsets over the token positions 0..n_toks
+struct dfa_builder
+{
+  struct glob_tok const *toks;
+  int n_toks;
+  int n_words;
+
+  uint64_t *sets;
+  int n_sets, cap_sets;
+};
+
+static void
+closure (struct dfa_builder const *b, uint64_t *set)
+{
+  // a star may match the empty string
+  for (int i = 0; i < b->n_toks; ++i)
+    {
+      if ((set[i / 64] & (1ULL << (i % 64))) && b->toks[i].star)
+        set[(i + 1) / 64] |= 1ULL << ((i + 1) % 64);
+    }
+}
+
+// returns the index of the state with the given set, adding it if necessary
+static int
+lookup_state (struct dfa_builder *b, uint64_t const *set)
+{
+  size_t sz = b->n_words * sizeof (uint64_t);
+
+  for (int i = 0; i < b->n_sets; ++i)
+    {
+      if (memcmp (&b->sets[i * b->n_words], set, sz) == 0)
+        return i;
+    }
+
+  if (b->n_sets == DFA_MAX_STATES)
+    return -2;
+
+  if (b->n_sets == b->cap_sets)
+    {
+      int cap = b->cap_sets ? 2 * b->cap_sets : 16;
+
+      uint64_t *tmp = realloc (b->sets, cap * sz);
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      b->sets = tmp;
+      b->cap_sets = cap;
+    }
+
+  memcpy (&b->sets[b->n_sets * b->n_words], set, sz);
+
+  return b->n_sets++;
+}
+
+// Returns 0 on success, 1 if the DFA would become too large and -1 on errors.
+static int
+build_dfa (struct matcher *m, struct glob_tok const *toks, int n_toks)
+{
+  struct dfa_builder b;
+
+  b.toks = toks;
+  b.n_toks = n_toks;
+  b.n_words = (n_toks + 1 + 63) / 64;
+
+  b.sets = NULL;
+  b.n_sets = b.cap_sets = 0;
+
+  int ret = -1;
+
+  uint16_t *trans = NULL;
+  unsigned char *accept = NULL;
+  int cap_states = 0;
+
+  uint64_t *set = calloc (b.n_words, sizeof (*set));
+  if (!set)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      goto out;
+    }
+
+  // dead state
+  if (lookup_state (&b, set) < 0)
+    goto out;
+
+  // start state
+  set[0] = 1;
+  closure (&b, set);
+
+  int start = lookup_state (&b, set);
+  if (start < 0)
+    goto out;
+
+  // every state added to b.sets is eventually expanded here
+  for (int s = 0; s < b.n_sets; ++s)
+    {
+      if (s == cap_states)
+        {
+          cap_states = cap_states ? 2 * cap_states : 16;
+
+          uint16_t *tmp_trans = realloc (trans,
+                                         cap_states * 256 * sizeof (*trans));
+          if (!tmp_trans)
+            {
+              fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+              goto out;
+            }
+
+          trans = tmp_trans;
+
+          unsigned char *tmp_accept = realloc (accept, cap_states);
+          if (!tmp_accept)
+            {
+              fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+              goto out;
+            }
+
+          accept = tmp_accept;
+        }
+
+      uint64_t const *from = &b.sets[s * b.n_words];
+
+      accept[s] = (from[n_toks / 64] >> (n_toks % 64)) & 1;
+
+      trans[s * 256] = 0;
+
+      for (int c = 1; c < 256; ++c)
+        {
+          memset (set, 0, b.n_words * sizeof (*set));
+
+          for (int i = 0; i < n_toks; ++i)
+            {
+              if (!(b.sets[s * b.n_words + i / 64] & (1ULL << (i % 64))))
+                continue;
+
+              if (toks[i].star)
+                set[i / 64] |= 1ULL << (i % 64);
+              else if (set_has (toks[i].set, c))
+                set[(i + 1) / 64] |= 1ULL << ((i + 1) % 64);
+            }
+
+          closure (&b, set);
+
+          int t = lookup_state (&b, set);
+          if (t == -2)
+            {
+              ret = 1;
+              goto out;
+            }
+          else if (t < 0)
+            goto out;
+
+          trans[s * 256 + c] = t;
+        }
+    }
+
+  m->kind = MATCH_DFA;
+  m->n_states = b.n_sets;
+  m->start = start;
+  m->trans = trans;
+  m->accept = accept;
+
+  trans = NULL;
+  accept = NULL;
+
+  ret = 0;
+
+out:
+  free (trans);
+  free (accept);
+  free (set);
+  free (b.sets);
+
+  return ret;
+}
+
+// === Matcher =================================================================
+
+static int
+set_literal (struct matcher *m, enum match_kind kind,
+             struct glob_tok const *toks, int n_toks)
+{
+  m->kind = kind;
+
+  m->lit = malloc (n_toks + 1);
+  if (!m->lit)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  for (int i = 0; i < n_toks; ++i)
+    m->lit[i] = set_single (toks[i].set);
+
+  m->lit[n_toks] = '\0';
+  m->lit_len = n_toks;
+
+  return 0;
+}
+
+int
+matcher_compile (struct matcher *m, char const *pattern)
+{
+  m->lit = NULL;
+  m->trans = NULL;
+  m->accept = NULL;
+  m->pattern = NULL;
+
+  struct glob_tok *toks;
+  int n_toks;
+
+  int ret = tokenize (pattern, &toks, &n_toks);
+  if (ret == -1)
+    return -1;
+
+  if (ret == 0)
+    {
+      // classify pattern by the position of its stars
+      int lead = n_toks > 0 && toks[0].star;
+      int trail = n_toks > lead && toks[n_toks - 1].star;
+
+      int literal = 1;
+      for (int i = lead; i < n_toks - trail; ++i)
+        {
+          if (toks[i].star || set_single (toks[i].set) == -1)
+            literal = 0;
+        }
+
+      struct glob_tok const *mid = toks + lead;
+      int n_mid = n_toks - lead - trail;
+
+      if (literal && lead && n_mid == 0)
+        {
+          m->kind = MATCH_ANY;
+          ret = 0;
+        }
+      else if (literal && !lead && !trail)
+        ret = set_literal (m, MATCH_LITERAL, mid, n_mid);
+      else if (literal && !lead)
+        ret = set_literal (m, MATCH_PREFIX, mid, n_mid);
+      else if (literal && !trail)
+        ret = set_literal (m, MATCH_SUFFIX, mid, n_mid);
+      else if (literal)
+        ret = set_literal (m, MATCH_CONTAINS, mid, n_mid);
+      else
+        ret = build_dfa (m, toks, n_toks);
+
+      free (toks);
+
+      if (ret != 1)
+        return ret;
+    }
+
+  // leave everything else to fnmatch
+  m->kind = MATCH_FNMATCH;
+
+  m->pattern = malloc (strlen (pattern) + 1);
+  if (!m->pattern)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  strcpy (m->pattern, pattern);
+
+  return 0;
+}
+
+void
+matcher_free (struct matcher *m)
+{
+  free (m->lit);
+  free (m->trans);
+  free (m->accept);
+  free (m->pattern);
+}
+
+int
+matcher_match (struct matcher const *m, char const *name)
+{
+  switch (m->kind)
+    {
+    case MATCH_ANY:
+      return 1;
+    case MATCH_LITERAL:
+      return strcmp (name, m->lit) == 0;
+    case MATCH_PREFIX:
+      return strncmp (name, m->lit, m->lit_len) == 0;
+    case MATCH_SUFFIX:
+      {
+        size_t len = strlen (name);
+
+        return len >= m->lit_len
+               && memcmp (name + len - m->lit_len, m->lit, m->lit_len) == 0;
+      }
+    case MATCH_CONTAINS:
+      return strstr (name, m->lit) != NULL;
+    case MATCH_DFA:
+      {
+        int s = m->start;
+
+        for (unsigned char const *p = (unsigned char const *) name; *p; ++p)
+          {
+            if (!(s = m->trans[s * 256 + *p]))
+              return 0;
+          }
+
+        return m->accept[s];
+      }
+    case MATCH_FNMATCH:
+      switch (fnmatch (m->pattern, name, 0))
+        {
+        case 0:
+          return 1;
+        case FNM_NOMATCH:
+          return 0;
+        default:
+          fprintf (stderr, "%s: fnmatch failed\n", prog_name);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,367 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find.h"
+#include "multimatch.h"
+
+#define AC_NONE UINT32_MAX
+
+// patterns that go into the automaton
+struct ac_key
+{
+  int anchor_begin, anchor_end;
+  char *lit;
+};
+
+// === Aho-Corasick construction ===============================================
+
+static int
+ac_add_state (struct multi_matcher *mm, int *cap)
+{
+  if (mm->n_states == *cap)
+    {
+      int new_cap = *cap ? 2 * *cap : 64;
+
+      uint32_t *tmp_trans = realloc (
+        mm->trans, (size_t) new_cap * mm->n_classes * sizeof (*tmp_trans));
+      if (!tmp_trans)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      mm->trans = tmp_trans;
+
+      unsigned char *tmp_accept = realloc (mm->accept, new_cap);
+      if (!tmp_accept)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      mm->accept = tmp_accept;
+
+      *cap = new_cap;
+    }
+
+  int s = mm->n_states++;
+
+  for (int c = 0; c < mm->n_classes; ++c)
+    mm->trans[(size_t) s * mm->n_classes + c] = AC_NONE;
+
+  mm->accept[s] = 0;
+
+  return s;
+}
+
+static int
+ac_build (struct multi_matcher *mm, struct ac_key const *keys, int n_keys)
+{
+  // bytes that do not occur in any pattern share class 0, the anchors get
+  // the last two classes
+  memset (mm->cls, 0, sizeof (mm->cls));
+
+  int n_classes = 1;
+
+  for (int i = 0; i < n_keys; ++i)
+    {
+      for (unsigned char const *p = (unsigned char const *) keys[i].lit; *p; ++p)
+        {
+          if (!mm->cls[*p])
+            mm->cls[*p] = n_classes++;
+        }
+    }
+
+  int begin = n_classes++;
+  int end = n_classes++;
+
+  mm->n_classes = n_classes;
+
+  // build trie
+  int cap = 0;
+  if (ac_add_state (mm, &cap) != 0)
+    return -1;
+
+  for (int i = 0; i < n_keys; ++i)
+    {
+      size_t len = strlen (keys[i].lit);
+      int s = 0;
+
+      for (size_t j = 0; j < len + 2; ++j)
+        {
+          int c;
+          if (j == 0)
+            {
+              if (!keys[i].anchor_begin)
+                continue;
+
+              c = begin;
+            }
+          else if (j == len + 1)
+            {
+              if (!keys[i].anchor_end)
+                continue;
+
+              c = end;
+            }
+          else
+            c = mm->cls[(unsigned char) keys[i].lit[j - 1]];
+
+          uint32_t *t = &mm->trans[(size_t) s * n_classes + c];
+
+          if (*t == AC_NONE)
+            {
+              int next = ac_add_state (mm, &cap);
+              if (next < 0)
+                return -1;
+
+              // ac_add_state may have moved the table
+              t = &mm->trans[(size_t) s * n_classes + c];
+              *t = next;
+            }
+
+          s = *t;
+        }
+
+      mm->accept[s] = 1;
+    }
+
+  // compute failure links breadth first and complete the transitions
+  uint32_t *fail = malloc (mm->n_states * sizeof (*fail));
+  uint32_t *queue = malloc (mm->n_states * sizeof (*queue));
+
+  if (!fail || !queue)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      free (fail);
+      free (queue);
+      return -1;
+    }
+
+  int head = 0, tail = 0;
+
+  for (int c = 0; c < n_classes; ++c)
+    {
+      uint32_t *t = &mm->trans[c];
+
+      if (*t == AC_NONE)
+        *t = 0;
+      else
+        {
+          fail[*t] = 0;
+          queue[tail++] = *t;
+        }
+    }
+
+  while (head < tail)
+    {
+      uint32_t s = queue[head++];
+
+      for (int c = 0; c < n_classes; ++c)
+        {
+          uint32_t *t = &mm->trans[(size_t) s * n_classes + c];
+          uint32_t f = mm->trans[(size_t) fail[s] * n_classes + c];
+
+          if (*t == AC_NONE)
+            *t = f;
+          else
+            {
+              fail[*t] = f;
+              mm->accept[*t] |= mm->accept[f];
+              queue[tail++] = *t;
+            }
+        }
+    }
+
+  free (fail);
+  free (queue);
+
+  return 0;
+}
+
+// === Multi matcher ===========================================================
+
+static int
+add_pattern (struct multi_matcher *mm, char const *pattern,
+             struct ac_key **keys, int *n_keys, int *cap_keys, int *cap_rest)
+{
+  struct matcher m;
+  if (matcher_compile (&m, pattern) != 0)
+    return -1;
+
+  switch (m.kind)
+    {
+    case MATCH_ANY:
+      mm->any = 1;
+      matcher_free (&m);
+      return 0;
+    case MATCH_LITERAL:
+    case MATCH_PREFIX:
+    case MATCH_SUFFIX:
+    case MATCH_CONTAINS:
+      if (*n_keys == *cap_keys)
+        {
+          int cap = *cap_keys ? 2 * *cap_keys : 64;
+
+          struct ac_key *tmp = realloc (*keys, cap * sizeof (*tmp));
+          if (!tmp)
+            {
+              fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+              matcher_free (&m);
+              return -1;
+            }
+
+          *keys = tmp;
+          *cap_keys = cap;
+        }
+
+      struct ac_key *key = &(*keys)[(*n_keys)++];
+
+      key->anchor_begin = (m.kind == MATCH_LITERAL || m.kind == MATCH_PREFIX);
+      key->anchor_end = (m.kind == MATCH_LITERAL || m.kind == MATCH_SUFFIX);
+
+      // take over the literal
+      key->lit = m.lit;
+      m.lit = NULL;
+
+      matcher_free (&m);
+      return 0;
+    default:
+      if (mm->n_rest == *cap_rest)
+        {
+          int cap = *cap_rest ? 2 * *cap_rest : 16;
+
+          struct matcher *tmp = realloc (mm->rest, cap * sizeof (*tmp));
+          if (!tmp)
+            {
+              fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+              matcher_free (&m);
+              return -1;
+            }
+
+          mm->rest = tmp;
+          *cap_rest = cap;
+        }
+
+      mm->rest[mm->n_rest++] = m;
+      return 0;
+    }
+}
+
+// Load patterns from file, one per line, empty lines are ignored.
+int
+multi_matcher_load (struct multi_matcher *mm, char const *file)
+{
+  mm->any = 0;
+  mm->n_classes = mm->n_states = 0;
+  mm->trans = NULL;
+  mm->accept = NULL;
+  mm->rest = NULL;
+  mm->n_rest = 0;
+
+  FILE *fp = fopen (file, "r");
+  if (!fp)
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, file, strerror (errno));
+      return -1;
+    }
+
+  struct ac_key *keys = NULL;
+  int n_keys = 0, cap_keys = 0, cap_rest = 0;
+
+  int err = 0;
+
+  char *line = NULL;
+  size_t line_sz = 0;
+  ssize_t len;
+
+  while ((len = getline (&line, &line_sz, fp)) != -1)
+    {
+      if (len > 0 && line[len - 1] == '\n')
+        line[--len] = '\0';
+
+      if (len == 0)
+        continue;
+
+      if ((err = add_pattern (mm, line, &keys, &n_keys, &cap_keys,
+                              &cap_rest)) != 0)
+        {
+          break;
+        }
+    }
+
+  if (!err && ferror (fp))
+    {
+      fprintf (stderr, "%s: %s: %s\n", prog_name, file, strerror (errno));
+      err = -1;
+    }
+
+  free (line);
+  fclose (fp);
+
+  if (!err)
+    err = ac_build (mm, keys, n_keys);
+
+  for (int i = 0; i < n_keys; ++i)
+    free (keys[i].lit);
+
+  free (keys);
+
+  if (err)
+    multi_matcher_free (mm);
+
+  return err;
+}
+
+void
+multi_matcher_free (struct multi_matcher *mm)
+{
+  free (mm->trans);
+  free (mm->accept);
+
+  for (int i = 0; i < mm->n_rest; ++i)
+    matcher_free (&mm->rest[i]);
+
+  free (mm->rest);
+
+  mm->trans = NULL;
+  mm->accept = NULL;
+  mm->rest = NULL;
+  mm->n_rest = 0;
+}
+
+int
+multi_matcher_match (struct multi_matcher const *mm, char const *name)
+{
+  if (mm->any)
+    return 1;
+
+  uint32_t const *trans = mm->trans;
+  unsigned char const *accept = mm->accept;
+  int n_classes = mm->n_classes;
+
+  // the anchors are the last two classes
+  uint32_t s = trans[n_classes - 2];
+  if (accept[s])
+    return 1;
+
+  for (unsigned char const *p = (unsigned char const *) name; *p; ++p)
+    {
+      s = trans[(size_t) s * n_classes + mm->cls[*p]];
+      if (accept[s])
+        return 1;
+    }
+
+  if (accept[trans[(size_t) s * n_classes + n_classes - 1]])
+    return 1;
+
+  for (int i = 0; i < mm->n_rest; ++i)
+    {
+      if (matcher_match (&mm->rest[i], name))
+        return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,235 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "find.h"
+#include "format.h"
+#include "output.h"
+#include "stats.h"
+
+// keeps flushes of different buffers from interleaving
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// buffer (and format) matching entries are printed to by the traversal
+// running on this thread, NULL if it does not print them itself
+static __thread struct out_buf *thread_out;
+static __thread struct format const *thread_format;
+
+static int
+out_writev (int fd, struct iovec *iov, int iovcnt)
+{
+  uint64_t start = stats_clock ();
+
+  while (iovcnt > 0)
+    {
+      ssize_t n = writev (fd, iov, iovcnt);
+      if (n == -1)
+        {
+          if (errno == EINTR)
+            continue;
+
+          fprintf (stderr, "%s: write error: %s\n", prog_name,
+                   strerror (errno));
+          stats_add_time (PHASE_OUTPUT, start);
+          return -1;
+        }
+
+      // skip what has been written
+      while (iovcnt > 0 && (size_t) n >= iov->iov_len)
+        {
+          n -= iov->iov_len;
+          ++iov;
+          --iovcnt;
+        }
+
+      if (iovcnt > 0)
+        {
+          iov->iov_base = (char *) iov->iov_base + n;
+          iov->iov_len -= n;
+        }
+    }
+
+  stats_add_time (PHASE_OUTPUT, start);
+
+  return 0;
+}
+
+int
+out_init (struct out_buf *ob, int fd, char term)
+{
+  ob->fd = fd;
+  ob->term = term;
+
+  ob->buf = malloc (OUT_BUF_SZ);
+  if (!ob->buf)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  ob->len = 0;
+
+  return 0;
+}
+
+// flushes remaining output
+int
+out_free (struct out_buf *ob)
+{
+  int err = out_flush (ob);
+
+  free (ob->buf);
+  ob->buf = NULL;
+
+  return err;
+}
+
+int
+out_flush (struct out_buf *ob)
+{
+  if (ob->len == 0)
+    return 0;
+
+  struct iovec iov = { ob->buf, ob->len };
+
+  pthread_mutex_lock (&out_lock);
+  int err = out_writev (ob->fd, &iov, 1);
+  pthread_mutex_unlock (&out_lock);
+
+  ob->len = 0;
+
+  return err;
+}
+
+// append raw data
+int
+out_write (struct out_buf *ob, char const *data, size_t len)
+{
+  if (ob->len + len > OUT_BUF_SZ)
+    {
+      if (out_flush (ob) != 0)
+        return -1;
+
+      if (len > OUT_BUF_SZ)
+        {
+          struct iovec iov = { (char *) data, len };
+
+          pthread_mutex_lock (&out_lock);
+          int err = out_writev (ob->fd, &iov, 1);
+          pthread_mutex_unlock (&out_lock);
+
+          return err;
+        }
+    }
+
+  memcpy (ob->buf + ob->len, data, len);
+  ob->len += len;
+
+  return 0;
+}
+
+// append a path followed by the terminator
+int
+out_path (struct out_buf *ob, char const *path, size_t len)
+{
+  if (ob->len + len + 1 <= OUT_BUF_SZ)
+    {
+      memcpy (ob->buf + ob->len, path, len);
+      ob->buf[ob->len + len] = ob->term;
+      ob->len += len + 1;
+
+      return 0;
+    }
+
+  // write buffer, path and terminator in one go rather than copying
+  struct iovec iov[3] =
+  {
+    { ob->buf, ob->len },
+    { (char *) path, len },
+    { &ob->term, 1 }
+  };
+
+  pthread_mutex_lock (&out_lock);
+  int err = out_writev (ob->fd, iov, 3);
+  pthread_mutex_unlock (&out_lock);
+
+  ob->len = 0;
+
+  return err;
+}
+
+// Append the record of a matching entry (whose path is path_len bytes long)
+// in format f, or just its path if f is NULL.
+int
+out_entry (struct out_buf *ob, struct format const *f, struct entry const *e,
+           size_t path_len)
+{
+  if (!f)
+    return out_path (ob, e->path, path_len);
+
+  size_t max = format_max (f, path_len);
+
+  if (ob->len + max > OUT_BUF_SZ && out_flush (ob) != 0)
+    return -1;
+
+  if (max <= OUT_BUF_SZ)
+    {
+      ob->len += format_entry (f, e, path_len, ob->buf + ob->len);
+      return 0;
+    }
+
+  // records of very long paths are built separately
+  char *rec = malloc (max);
+  if (!rec)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  int err = out_write (ob, rec, format_entry (f, e, path_len, rec));
+
+  free (rec);
+
+  return err;
+}
+
+// === Commands ================================================================
+
+// Set the buffer the calling thread prints matching entries to in format f,
+// out_sync writes it out before commands are started. NULL unbinds it.
+void
+out_bind (struct out_buf *ob, struct format const *f)
+{
+  thread_out = ob;
+  thread_format = f;
+}
+
+// Write out everything printed so far by the calling thread, including e if
+// it has reached -print already, so that it precedes the output of a command
+// about to be started. e may be NULL.
+int
+out_sync (struct entry *e)
+{
+  struct out_buf *ob = thread_out;
+  if (!ob)
+    return 0;
+
+  if (e && e->print && !e->printed)
+    {
+      e->printed = 1;
+
+      // as when printing it afterwards, entries that cannot be stat'ed for
+      // their record are left out
+      if ((!thread_format || entry_stat (e, thread_format->stat_mask) == 0)
+          && out_entry (ob, thread_format, e, strlen (e->path)) != 0)
+        {
+          return -1;
+        }
+    }
+
+  return out_flush (ob);
+}
@@ -0,0 +1,134 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find.h"
+#include "pathbuf.h"
+
+#define PATH_BUF_INIT_SZ 4096
+
+static int
+path_buf_reserve (struct path_buf *pb, size_t len)
+{
+  if (len + 1 <= pb->cap)
+    return 0;
+
+  size_t cap = pb->cap;
+  while (len + 1 > cap)
+    cap *= 2;
+
+  char *tmp = realloc (pb->buf, cap);
+  if (!tmp)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  pb->buf = tmp;
+  pb->cap = cap;
+
+  return 0;
+}
+
+int
+path_buf_init (struct path_buf *pb)
+{
+  pb->buf = malloc (PATH_BUF_INIT_SZ);
+  if (!pb->buf)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  pb->buf[0] = '\0';
+  pb->len = 0;
+  pb->cap = PATH_BUF_INIT_SZ;
+
+  return 0;
+}
+
+void
+path_buf_free (struct path_buf *pb)
+{
+  free (pb->buf);
+}
+
+int
+path_buf_set (struct path_buf *pb, char const *path)
+{
+  size_t len = strlen (path);
+
+  if (path_buf_reserve (pb, len) != 0)
+    return -1;
+
+  memcpy (pb->buf, path, len + 1);
+  pb->len = len;
+
+  return 0;
+}
+
+// append '/' and name, the previous length can be restored with
+// path_buf_truncate
+int
+path_buf_push (struct path_buf *pb, char const *name)
+{
+  size_t len = strlen (name);
+
+  if (path_buf_reserve (pb, pb->len + len + 1) != 0)
+    return -1;
+
+  pb->buf[pb->len] = '/';
+  memcpy (pb->buf + pb->len + 1, name, len + 1);
+  pb->len += len + 1;
+
+  return 0;
+}
+
+// append len raw bytes of data without a separator
+int
+path_buf_append (struct path_buf *pb, char const *data, size_t len)
+{
+  if (path_buf_reserve (pb, pb->len + len) != 0)
+    return -1;
+
+  memcpy (pb->buf + pb->len, data, len);
+  pb->len += len;
+  pb->buf[pb->len] = '\0';
+
+  return 0;
+}
+
+void
+path_buf_truncate (struct path_buf *pb, size_t len)
+{
+  pb->len = len;
+  pb->buf[len] = '\0';
+}
+
+// === Path order ==============================================================
+
+// Compare paths bytewise, '/' sorts before every other character so that
+// this is the order in which a pre-order traversal visiting the entries of
+// each directory by name encounters them.
+int
+path_cmp (char const *a, char const *b)
+{
+  while (*a != '\0' && *a == *b)
+    {
+      ++a;
+      ++b;
+    }
+
+  int ka = *a == '\0' ? 0 : *a == '/' ? 1 : (unsigned char) *a + 1;
+  int kb = *b == '\0' ? 0 : *b == '/' ? 1 : (unsigned char) *b + 1;
+
+  return ka - kb;
+}
+
+// whether path lies below the directory given by the first len bytes of dir
+int
+path_below (char const *path, char const *dir, size_t len)
+{
+  return strncmp (path, dir, len) == 0 && path[len] == '/';
+}
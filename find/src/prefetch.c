@@ -0,0 +1,318 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find.h"
+#include "format.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "xstat.h"
+
+// With -inode-order or -uring, every directory is read in full before it is
+// traversed and the entries that will be stat'ed while visiting them are
+// stat'ed right away (through io_uring with -uring, the results are stored
+// as the requests complete), with all the fields visiting them is going to
+// ask for.
+// The directory is then traversed from this listing rather than read again,
+// and the stat data is handed to the visit along with each entry. Entries
+// are still visited (and printed) in directory order.
+//
+// -inode-order issues these calls in the order of the inode numbers, on
+// rotating disks this turns seeks all over the inode table into a mostly
+// sequential sweep. -uring submits them all at once through io_uring so that
+// the device sees many requests in flight, falling back to one call at a time
+// if io_uring is not available.
+
+void
+prefetch_init (struct prefetch *pf)
+{
+  pf->have_dr = 0;
+
+  pf->keys = NULL;
+  pf->reqs = NULL;
+  pf->cap_keys = 0;
+
+  pf->ring_state = 0;
+}
+
+void
+prefetch_free (struct prefetch *pf)
+{
+  if (pf->have_dr)
+    dir_reader_free (&pf->dr);
+
+  if (pf->ring_state == 1)
+    uring_free (&pf->ring);
+
+  free (pf->keys);
+  free (pf->reqs);
+
+  prefetch_init (pf);
+}
+
+void
+prefetch_list_init (struct prefetch_list *list)
+{
+  list->ents = NULL;
+  list->n_ents = list->cap_ents = 0;
+
+  list->names = NULL;
+  list->len = list->cap = 0;
+
+  list->stats = NULL;
+  list->cap_stats = 0;
+
+  list->pos = 0;
+}
+
+void
+prefetch_list_free (struct prefetch_list *list)
+{
+  free (list->ents);
+  free (list->names);
+  free (list->stats);
+
+  prefetch_list_init (list);
+}
+
+// whether visiting an entry of type d_type is going to stat it
+static int
+needs_stat (struct find_opts const *opts, unsigned char d_type)
+{
+  return d_type == DT_UNKNOWN || opts->expr->stat_mask != 0
+         || (d_type == DT_REG && opts->dupes) || opts->du
+         || (opts->format && opts->format->stat_mask != 0)
+         || (d_type == DT_LNK && opts->follow)
+         || (d_type == DT_DIR && (opts->follow || opts->xdev));
+}
+
+static int
+add_entry (struct prefetch_list *list, struct dir_entry const *entry,
+           long stat)
+{
+  size_t sz = strlen (entry->name) + 1;
+
+  if (list->n_ents == list->cap_ents)
+    {
+      size_t n = list->cap_ents ? 2 * list->cap_ents : 256;
+
+      struct prefetch_entry *tmp = realloc (list->ents, n * sizeof (*tmp));
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      list->ents = tmp;
+      list->cap_ents = n;
+    }
+
+  if (list->len + sz > list->cap)
+    {
+      size_t n = list->cap ? list->cap : 4096;
+      while (list->len + sz > n)
+        n *= 2;
+
+      char *tmp = realloc (list->names, n);
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      list->names = tmp;
+      list->cap = n;
+    }
+
+  memcpy (list->names + list->len, entry->name, sz);
+
+  struct prefetch_entry *ent = &list->ents[list->n_ents++];
+
+  ent->name = list->len;
+  ent->ino = entry->ino;
+  ent->type = entry->type;
+  ent->stat = stat;
+
+  list->len += sz;
+
+  return 0;
+}
+
+// make room for n entries in the scratch arrays and for their stat data
+static int
+reserve_stats (struct prefetch *pf, struct prefetch_list *list, size_t n)
+{
+  if (n > pf->cap_keys)
+    {
+      struct prefetch_key *keys = realloc (pf->keys, n * sizeof (*keys));
+      if (keys)
+        pf->keys = keys;
+
+      struct uring_req *reqs = realloc (pf->reqs, n * sizeof (*reqs));
+      if (reqs)
+        pf->reqs = reqs;
+
+      if (!keys || !reqs)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      pf->cap_keys = n;
+    }
+
+  if (n > list->cap_stats)
+    {
+      struct prefetch_stat *tmp = realloc (list->stats, n * sizeof (*tmp));
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      list->stats = tmp;
+      list->cap_stats = n;
+    }
+
+  return 0;
+}
+
+static int
+cmp_ino (void const *a, void const *b)
+{
+  ino_t x = ((struct prefetch_key const *) a)->ino;
+  ino_t y = ((struct prefetch_key const *) b)->ino;
+
+  return (x > y) - (x < y);
+}
+
+// Read the directory fd in full into list and stat the entries that will
+// need it (in inode order with -inode-order), fd is not read any further.
+// Errors of single entries are left for the visit to report, returns -1 if
+// the directory cannot be read.
+int
+prefetch_dir (struct prefetch *pf, struct prefetch_list *list,
+              struct find_opts const *opts, int fd)
+{
+  if (!pf->have_dr)
+    {
+      if (dir_reader_init (&pf->dr) != 0)
+        return -1;
+
+      pf->have_dr = 1;
+    }
+
+  dir_reader_reset (&pf->dr, fd);
+
+  list->n_ents = list->len = list->pos = 0;
+
+  size_t n_stats = 0;
+
+  int ret;
+  struct dir_entry entry;
+
+  while ((ret = dir_read (&pf->dr, &entry)) == 1)
+    {
+      long stat = needs_stat (opts, entry.type) ? (long) n_stats++ : -1;
+
+      if (add_entry (list, &entry, stat) != 0)
+        return -1;
+    }
+
+  if (ret == -1)
+    return -1;
+
+  if (n_stats == 0)
+    return 0;
+
+  if (reserve_stats (pf, list, n_stats) != 0)
+    return -1;
+
+  size_t k = 0;
+  for (size_t i = 0; i < list->n_ents; ++i)
+    {
+      if (list->ents[i].stat != -1)
+        pf->keys[k++] = (struct prefetch_key) { list->ents[i].ino, i };
+    }
+
+  if (opts->inode_order)
+    qsort (pf->keys, n_stats, sizeof (*pf->keys), cmp_ino);
+
+  // stat data is stored in the order of the calls
+  for (k = 0; k < n_stats; ++k)
+    {
+      struct prefetch_entry *ent = &list->ents[pf->keys[k].ent];
+
+      ent->stat = k;
+      list->stats[k].ok = 0;
+
+      pf->reqs[k].name = list->names + ent->name;
+      pf->reqs[k].stx = &list->stats[k].stx;
+    }
+
+  int flags = opts->follow ? 0 : AT_SYMLINK_NOFOLLOW;
+  unsigned mask = entry_mask (opts);
+
+  if (opts->uring && pf->ring_state == 0)
+    pf->ring_state = (uring_init (&pf->ring) == 0) ? 1 : -1;
+
+  // requests went through the ring, those not carried out are left with
+  // -ECANCELED
+  int ringed = 0;
+
+  // nothing to be gained from a single call
+  if (opts->uring && pf->ring_state == 1 && n_stats > 1)
+    {
+      uint64_t start = stats_clock ();
+      int err = uring_statx (&pf->ring, fd, pf->reqs, n_stats, flags, mask);
+      stats_add_time (PHASE_STAT, start);
+
+      // no request is in flight anymore, continue without the ring
+      if (err != 0)
+        {
+          uring_free (&pf->ring);
+          pf->ring_state = -1;
+        }
+
+      ringed = 1;
+    }
+
+  for (k = 0; k < n_stats; ++k)
+    {
+      struct prefetch_stat *st = &list->stats[k];
+
+      if (ringed && pf->reqs[k].res != -ECANCELED)
+        st->ok = (pf->reqs[k].res == 0);
+      else
+        st->ok = (xstatat (fd, pf->reqs[k].name, flags, mask, &st->stx) == 0);
+    }
+
+  return 0;
+}
+
+// Return the next entry of the directory in *entry, and its stat data in
+// *stx (NULL if it was not stat'ed or the call failed). Returns 0 once all
+// entries have been returned.
+int
+prefetch_next (struct prefetch_list *list, struct dir_entry *entry,
+               struct linux_statx const **stx)
+{
+  if (list->pos == list->n_ents)
+    return 0;
+
+  struct prefetch_entry const *ent = &list->ents[list->pos++];
+
+  entry->name = list->names + ent->name;
+  entry->type = ent->type;
+  entry->ino = ent->ino;
+
+  *stx = NULL;
+
+  if (ent->stat != -1 && list->stats[ent->stat].ok)
+    *stx = &list->stats[ent->stat].stx;
+
+  return 1;
+}
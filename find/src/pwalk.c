@@ -0,0 +1,991 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "dirread.h"
+#include "find.h"
+#include "format.h"
+#include "output.h"
+#include "pathbuf.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "watch.h"
+
+// Parallel traversal: every directory that has to be read becomes a task.
+// Each worker owns a deque of tasks, pushes the subdirectories it discovers
+// to the bottom of its own deque and pops from there (i.e. walks depth first
+// like the sequential find), idle workers steal from the top of other
+// workers' deques, which hands them the largest remaining subtrees.
+//
+// With -ordered, output is not printed right away but collected per task as
+// a list of segments, each followed by the output of one subdirectory task.
+// Finished tasks are emitted in sequential (pre-)order as soon as all of
+// their predecessors have been emitted.
+
+#define DEQUE_INIT_SZ 64
+
+// === Tasks ===================================================================
+
+struct segment
+{
+  char *buf;
+  size_t len, cap;
+
+  struct task *child;  // task whose output follows this segment, or NULL
+
+  struct segment *next;
+};
+
+// Tasks do not keep a copy of their path or of the identities of their
+// ancestors, each links to its parent's task instead, which lives on as long
+// as any of its children. Paths are rebuilt from the names along these links
+// when a task is processed.
+struct task
+{
+  struct task *up;  // task of the parent directory, NULL for the root
+  int refs;         // one for the task itself and one for each child
+
+  int depth;
+
+  // identity of the directory, used for loop detection (-follow)
+  dev_t dev;
+  ino_t ino;
+
+  struct du_sum usage;  // -du, usage of the directory itself
+
+  // -ordered only
+  int done;
+  struct segment *head, *tail;
+
+  char name[];  // name within the parent directory, the path for the root
+};
+
+static struct task *
+create_task (char const *name, struct task *parent, dev_t dev, ino_t ino,
+             struct du_sum const *usage)
+{
+  size_t len = strlen (name);
+
+  struct task *t = malloc (sizeof (*t) + len + 1);
+  if (!t)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  t->up = parent;
+  t->refs = 1;
+  t->depth = parent ? parent->depth + 1 : 0;
+  t->dev = dev;
+  t->ino = ino;
+  t->usage = *usage;
+
+  t->done = 0;
+  t->head = t->tail = NULL;
+
+  memcpy (t->name, name, len + 1);
+
+  if (parent)
+    __atomic_add_fetch (&parent->refs, 1, __ATOMIC_RELAXED);
+
+  return t;
+}
+
+// drop a reference to t, freeing it (and then possibly its ancestors) once
+// nothing refers to it anymore
+static void
+put_task (struct task *t)
+{
+  while (t && __atomic_sub_fetch (&t->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      struct task *up = t->up;
+      free (t);
+      t = up;
+    }
+}
+
+static void
+free_task (struct task *t)
+{
+  while (t->head)
+    {
+      struct segment *next = t->head->next;
+
+      if (t->head->child)
+        free_task (t->head->child);
+
+      free (t->head->buf);
+      free (t->head);
+
+      t->head = next;
+    }
+
+  put_task (t);
+}
+
+// rebuild the path of t from the names of its ancestors
+static int
+task_path (struct task const *t, struct path_buf *pb)
+{
+  if (!t->up)
+    return path_buf_set (pb, t->name);
+
+  if (task_path (t->up, pb) != 0)
+    return -1;
+
+  return path_buf_push (pb, t->name);
+}
+
+static struct segment *
+task_segment (struct task *t)
+{
+  if (t->tail && !t->tail->child)
+    return t->tail;
+
+  struct segment *seg = malloc (sizeof (*seg));
+  if (!seg)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  seg->buf = NULL;
+  seg->len = seg->cap = 0;
+  seg->child = NULL;
+  seg->next = NULL;
+
+  if (t->tail)
+    t->tail->next = seg;
+  else
+    t->head = seg;
+
+  t->tail = seg;
+
+  return seg;
+}
+
+// append the entry (whose path is len bytes long) in format f, or just its
+// path followed by term if f is NULL
+static int
+task_print (struct task *t, struct format const *f, struct entry const *e,
+            size_t len, char term)
+{
+  struct segment *seg = task_segment (t);
+  if (!seg)
+    return -1;
+
+  size_t max = f ? format_max (f, len) : len + 1;
+
+  if (seg->len + max > seg->cap)
+    {
+      size_t cap = seg->cap ? seg->cap : 256;
+      while (seg->len + max > cap)
+        cap *= 2;
+
+      char *tmp = realloc (seg->buf, cap);
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      seg->buf = tmp;
+      seg->cap = cap;
+    }
+
+  if (f)
+    {
+      seg->len += format_entry (f, e, len, seg->buf + seg->len);
+      return 0;
+    }
+
+  memcpy (seg->buf + seg->len, e->path, len);
+  seg->buf[seg->len + len] = term;
+  seg->len += len + 1;
+
+  return 0;
+}
+
+static int
+task_add_child (struct task *t, struct task *child)
+{
+  struct segment *seg = task_segment (t);
+  if (!seg)
+    return -1;
+
+  seg->child = child;
+
+  return 0;
+}
+
+// === Pool ====================================================================
+
+// state shared by the workers of one traversal
+struct pool
+{
+  struct find_opts const *opts;
+
+  struct worker *workers;
+  int n_workers;
+
+  long n_pending;  // tasks created but not yet processed
+  long n_queued;   // tasks currently sitting in a deque
+  int failed;
+
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_cond;
+  long n_idle;
+
+  pthread_mutex_t emit_lock;
+
+  // output of the main thread and of the emitter
+  struct out_buf main_out;
+
+  // stack of tasks whose output is currently being emitted, the bottom
+  // element is the root task, every other element is a child of the element
+  // below it
+  struct task **emit_stack;
+  int emit_stack_sz, emit_stack_cap;
+};
+
+// === Ordered output ==========================================================
+
+static int
+emit_push (struct pool *pool, struct task *t)
+{
+  if (pool->emit_stack_sz == pool->emit_stack_cap)
+    {
+      int cap = pool->emit_stack_cap ? 2 * pool->emit_stack_cap : 64;
+
+      struct task **tmp = realloc (pool->emit_stack, cap * sizeof (*tmp));
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      pool->emit_stack = tmp;
+      pool->emit_stack_cap = cap;
+    }
+
+  pool->emit_stack[pool->emit_stack_sz++] = t;
+
+  return 0;
+}
+
+// must be called with emit_lock held
+static int
+emit (struct pool *pool)
+{
+  while (pool->emit_stack_sz > 0)
+    {
+      struct task *t = pool->emit_stack[pool->emit_stack_sz - 1];
+      if (!t->done)
+        return 0;
+
+      struct segment *seg = t->head;
+      if (!seg)
+        {
+          --pool->emit_stack_sz;
+          free_task (t);
+          continue;
+        }
+
+      t->head = seg->next;
+
+      struct task *child = seg->child;
+
+      int err = out_write (&pool->main_out, seg->buf, seg->len);
+
+      free (seg->buf);
+      free (seg);
+
+      if (err != 0)
+        {
+          if (child)
+            free_task (child);
+
+          return -1;
+        }
+
+      if (child && emit_push (pool, child) != 0)
+        {
+          free_task (child);
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+// === Work stealing deques ====================================================
+
+struct deque
+{
+  pthread_mutex_t lock;
+
+  struct task **buf;
+  size_t cap;
+  size_t top, bottom;  // occupied slots are [top, bottom) modulo cap
+};
+
+static int
+deque_init (struct deque *dq)
+{
+  pthread_mutex_init (&dq->lock, NULL);
+
+  dq->buf = malloc (DEQUE_INIT_SZ * sizeof (*dq->buf));
+  if (!dq->buf)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  dq->cap = DEQUE_INIT_SZ;
+  dq->top = dq->bottom = 0;
+
+  return 0;
+}
+
+static void
+deque_free (struct deque *dq)
+{
+  pthread_mutex_destroy (&dq->lock);
+  free (dq->buf);
+}
+
+static int
+deque_push (struct deque *dq, struct task *t)
+{
+  pthread_mutex_lock (&dq->lock);
+
+  if (dq->bottom - dq->top == dq->cap)
+    {
+      struct task **tmp = malloc (2 * dq->cap * sizeof (*tmp));
+      if (!tmp)
+        {
+          pthread_mutex_unlock (&dq->lock);
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          return -1;
+        }
+
+      for (size_t i = dq->top; i < dq->bottom; ++i)
+        tmp[i - dq->top] = dq->buf[i % dq->cap];
+
+      free (dq->buf);
+
+      dq->buf = tmp;
+      dq->bottom -= dq->top;
+      dq->top = 0;
+      dq->cap *= 2;
+    }
+
+  dq->buf[dq->bottom++ % dq->cap] = t;
+
+  pthread_mutex_unlock (&dq->lock);
+
+  return 0;
+}
+
+static struct task *
+deque_pop (struct deque *dq)
+{
+  struct task *t = NULL;
+
+  pthread_mutex_lock (&dq->lock);
+
+  if (dq->bottom != dq->top)
+    t = dq->buf[--dq->bottom % dq->cap];
+
+  pthread_mutex_unlock (&dq->lock);
+
+  return t;
+}
+
+static struct task *
+deque_steal (struct deque *dq)
+{
+  struct task *t = NULL;
+
+  pthread_mutex_lock (&dq->lock);
+
+  if (dq->bottom != dq->top)
+    t = dq->buf[dq->top++ % dq->cap];
+
+  pthread_mutex_unlock (&dq->lock);
+
+  return t;
+}
+
+// === Worker pool =============================================================
+
+struct worker
+{
+  struct pool *pool;
+  int id;
+  unsigned seed;
+  struct deque dq;
+  struct dir_reader dr;
+  struct ino_set active;
+  struct path_buf path;
+  struct out_buf out;
+  // -inode-order and -uring only, a worker reads one directory at a time
+  struct prefetch pf;
+  struct prefetch_list list;
+};
+
+static int
+worker_init (struct worker *w, struct pool *pool, int id, char term)
+{
+  w->pool = pool;
+  w->id = id;
+  w->seed = id + 1;
+
+  if (deque_init (&w->dq) != 0)
+    return -1;
+
+  if (dir_reader_init (&w->dr) != 0)
+    {
+      deque_free (&w->dq);
+      return -1;
+    }
+
+  if (ino_set_init (&w->active) != 0)
+    {
+      dir_reader_free (&w->dr);
+      deque_free (&w->dq);
+      return -1;
+    }
+
+  if (path_buf_init (&w->path) != 0)
+    {
+      ino_set_free (&w->active);
+      dir_reader_free (&w->dr);
+      deque_free (&w->dq);
+      return -1;
+    }
+
+  if (out_init (&w->out, STDOUT_FILENO, term) != 0)
+    {
+      path_buf_free (&w->path);
+      ino_set_free (&w->active);
+      dir_reader_free (&w->dr);
+      deque_free (&w->dq);
+      return -1;
+    }
+
+  prefetch_init (&w->pf);
+  prefetch_list_init (&w->list);
+
+  return 0;
+}
+
+// flushes the worker's output, returns -1 if that fails
+static int
+worker_free (struct worker *w)
+{
+  int err = out_free (&w->out);
+
+  path_buf_free (&w->path);
+  ino_set_free (&w->active);
+  dir_reader_free (&w->dr);
+  deque_free (&w->dq);
+  prefetch_free (&w->pf);
+  prefetch_list_free (&w->list);
+
+  return err;
+}
+
+static void
+wake_idle (struct pool *pool, int all)
+{
+  pthread_mutex_lock (&pool->idle_lock);
+
+  if (all)
+    pthread_cond_broadcast (&pool->idle_cond);
+  else
+    pthread_cond_signal (&pool->idle_cond);
+
+  pthread_mutex_unlock (&pool->idle_lock);
+}
+
+static int
+submit (struct worker *w, struct task *t)
+{
+  struct pool *pool = w->pool;
+
+  __atomic_add_fetch (&pool->n_pending, 1, __ATOMIC_SEQ_CST);
+
+  if (deque_push (&w->dq, t) != 0)
+    {
+      __atomic_sub_fetch (&pool->n_pending, 1, __ATOMIC_SEQ_CST);
+      return -1;
+    }
+
+  __atomic_add_fetch (&pool->n_queued, 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n (&pool->n_idle, __ATOMIC_SEQ_CST) > 0)
+    wake_idle (pool, 0);
+
+  return 0;
+}
+
+static struct task *
+next_task (struct worker *w)
+{
+  struct pool *pool = w->pool;
+  struct task *t = deque_pop (&w->dq);
+
+  if (!t)
+    {
+      int start = rand_r (&w->seed) % pool->n_workers;
+
+      for (int i = 0; i < pool->n_workers && !t; ++i)
+        {
+          int victim = (start + i) % pool->n_workers;
+          if (victim != w->id)
+            t = deque_steal (&pool->workers[victim].dq);
+        }
+    }
+
+  if (t)
+    __atomic_sub_fetch (&pool->n_queued, 1, __ATOMIC_SEQ_CST);
+
+  return t;
+}
+
+static void
+finish_task (struct pool *pool, struct task *t)
+{
+  if (pool->opts->ordered)
+    {
+      pthread_mutex_lock (&pool->emit_lock);
+
+      t->done = 1;
+
+      if (emit (pool) != 0)
+        __atomic_store_n (&pool->failed, 1, __ATOMIC_SEQ_CST);
+
+      pthread_mutex_unlock (&pool->emit_lock);
+    }
+  else
+    free_task (t);
+
+  if (__atomic_sub_fetch (&pool->n_pending, 1, __ATOMIC_SEQ_CST) == 0)
+    wake_idle (pool, 1);
+}
+
+// with -du, record the usage of the task's directory at path, sum holds the
+// usage of the directory itself and of the entries read from it
+static int
+record_usage (struct pool *pool, struct task const *t, char const *path,
+              struct du_sum const *sum)
+{
+  if (!pool->opts->du)
+    return 0;
+
+  return du_add_dir (pool->opts->du, path, t->depth, sum);
+}
+
+static int
+read_task (struct worker *w, struct task *t)
+{
+  struct pool *pool = w->pool;
+  struct find_opts const *opts = pool->opts;
+
+  // usage is added up locally and recorded once the directory has been read
+  struct du_sum sum = t->usage;
+
+  // the path of the directory has been rebuilt in the worker's path buffer
+  size_t path_len = w->path.len;
+
+  int dirfd = open_dir (w->path.buf);
+  if (dirfd == -1)
+    return record_usage (pool, t, w->path.buf, &sum);
+
+  ++thread_stats.dirs;
+
+  // watch the directory before reading it so that no later change is missed
+  if (opts->watch && watch_add (opts->watch, w->path.buf, t->depth) != 0)
+    {
+      close (dirfd);
+      return -1;
+    }
+
+  int listed = opts->inode_order || opts->uring;
+
+  if (listed && prefetch_dir (&w->pf, &w->list, opts, dirfd) != 0)
+    {
+      close (dirfd);
+      return -1;
+    }
+
+  dir_reader_reset (&w->dr, dirfd);
+
+  for (;;)
+    {
+      if (__atomic_load_n (&pool->failed, __ATOMIC_RELAXED))
+        break;
+
+      struct dir_entry entry;
+      struct linux_statx const *stx = NULL;
+
+      int ret = listed ? prefetch_next (&w->list, &entry, &stx)
+                       : dir_read (&w->dr, &entry);
+      if (ret == 0)
+        break;
+
+      if (ret == -1)
+        {
+          close (dirfd);
+          return -1;
+        }
+
+      // extend pathname
+      path_buf_truncate (&w->path, path_len);
+
+      if (path_buf_push (&w->path, entry.name) != 0)
+        {
+          close (dirfd);
+          return -1;
+        }
+
+      char const *next_path = w->path.buf;
+
+      struct entry e;
+      dev_t dev;
+      ino_t ino;
+      struct du_sum usage;
+
+      int flags = visit (opts, dirfd, entry.name, next_path, entry.type, stx,
+                         t->depth + 1, &w->active, &e, &dev, &ino, &usage);
+
+      if (flags == -1)
+        {
+          close (dirfd);
+          return -1;
+        }
+
+      if (flags & VISIT_MATCH)
+        {
+          if (opts->ordered)
+            {
+              if (task_print (t, opts->format, &e, w->path.len,
+                              w->out.term) != 0)
+                {
+                  close (dirfd);
+                  return -1;
+                }
+            }
+          else if (out_entry (&w->out, opts->format, &e, w->path.len) != 0)
+            {
+              close (dirfd);
+              return -1;
+            }
+        }
+
+      // subdirectories account for their own usage
+      if (!(flags & VISIT_DESCEND))
+        {
+          sum.apparent += usage.apparent;
+          sum.allocated += usage.allocated;
+          continue;
+        }
+
+      // hand subdirectory to the pool
+      struct task *child = create_task (entry.name, t, dev, ino, &usage);
+      if (!child)
+        {
+          close (dirfd);
+          return -1;
+        }
+
+      if (opts->ordered && task_add_child (t, child) != 0)
+        {
+          free_task (child);
+          close (dirfd);
+          return -1;
+        }
+
+      if (submit (w, child) != 0)
+        {
+          // an ordered parent owns its children and frees them itself
+          if (!opts->ordered)
+            free_task (child);
+          else
+            child->done = 1;
+
+          close (dirfd);
+          return -1;
+        }
+    }
+
+  close (dirfd);
+
+  path_buf_truncate (&w->path, path_len);
+
+  return record_usage (pool, t, w->path.buf, &sum);
+}
+
+static int
+process_task (struct worker *w, struct task *t)
+{
+  if (task_path (t, &w->path) != 0)
+    return -1;
+
+  if (!w->pool->opts->follow)
+    return read_task (w, t);
+
+  // the worker's active set holds the task and its ancestors while it is
+  // processed
+  struct task const *a;
+  for (a = t; a; a = a->up)
+    {
+      if (ino_set_insert (&w->active, a->dev, a->ino) == -1)
+        {
+          for (struct task const *b = t; b != a; b = b->up)
+            ino_set_remove (&w->active, b->dev, b->ino);
+
+          return -1;
+        }
+    }
+
+  int err = read_task (w, t);
+
+  for (a = t; a; a = a->up)
+    ino_set_remove (&w->active, a->dev, a->ino);
+
+  return err;
+}
+
+static void *
+worker_main (void *arg)
+{
+  struct worker *w = arg;
+  struct pool *pool = w->pool;
+  struct find_opts const *opts = pool->opts;
+
+  // output printed so far precedes that of commands run by -exec, with
+  // -ordered output is only collected here
+  if (!opts->ordered && !opts->on_match && !opts->dupes)
+    out_bind (&w->out, opts->format);
+
+  for (;;)
+    {
+      struct task *t = next_task (w);
+
+      if (t)
+        {
+          if (!__atomic_load_n (&pool->failed, __ATOMIC_RELAXED)
+              && process_task (w, t) != 0)
+            {
+              __atomic_store_n (&pool->failed, 1, __ATOMIC_SEQ_CST);
+            }
+
+          finish_task (pool, t);
+          continue;
+        }
+
+      // wait until new work is submitted or the traversal is complete
+      pthread_mutex_lock (&pool->idle_lock);
+
+      __atomic_add_fetch (&pool->n_idle, 1, __ATOMIC_SEQ_CST);
+
+      while (__atomic_load_n (&pool->n_queued, __ATOMIC_SEQ_CST) == 0
+             && __atomic_load_n (&pool->n_pending, __ATOMIC_SEQ_CST) > 0)
+        {
+          pthread_cond_wait (&pool->idle_cond, &pool->idle_lock);
+        }
+
+      __atomic_sub_fetch (&pool->n_idle, 1, __ATOMIC_SEQ_CST);
+
+      pthread_mutex_unlock (&pool->idle_lock);
+
+      if (__atomic_load_n (&pool->n_pending, __ATOMIC_SEQ_CST) == 0)
+        {
+          out_bind (NULL, NULL);
+          stats_merge ();
+          return NULL;
+        }
+    }
+}
+
+// === Parallel find function ==================================================
+
+int
+find_par (struct find_opts const *opts, char *root)
+{
+  // visit starting point on the main thread
+  struct entry e;
+  dev_t dev;
+  ino_t ino;
+  struct du_sum usage;
+
+  char term = opts->print0 ? '\0' : '\n';
+
+  struct pool pool = {
+    .opts = opts,
+    .n_workers = opts->n_threads,
+    .idle_lock = PTHREAD_MUTEX_INITIALIZER,
+    .idle_cond = PTHREAD_COND_INITIALIZER,
+    .emit_lock = PTHREAD_MUTEX_INITIALIZER,
+  };
+
+  if (out_init (&pool.main_out, STDOUT_FILENO, term) != 0)
+    return 1;
+
+  struct ino_set no_ancestors;
+  if (ino_set_init (&no_ancestors) != 0)
+    {
+      out_free (&pool.main_out);
+      return 1;
+    }
+
+  // output printed so far precedes that of commands run by -exec
+  if (!opts->on_match && !opts->dupes)
+    out_bind (&pool.main_out, opts->format);
+
+  int flags = visit (opts, AT_FDCWD, root, root, DT_UNKNOWN, NULL, 0,
+                     &no_ancestors, &e, &dev, &ino, &usage);
+
+  out_bind (NULL, NULL);
+
+  ino_set_free (&no_ancestors);
+
+  stats_merge ();
+
+  if (flags == -1)
+    {
+      out_free (&pool.main_out);
+      return 1;
+    }
+
+  if (flags & VISIT_MATCH)
+    {
+      if (out_entry (&pool.main_out, opts->format, &e, strlen (root)) != 0)
+        {
+          out_free (&pool.main_out);
+          return 1;
+        }
+    }
+
+  if (!(flags & VISIT_DESCEND))
+    return out_free (&pool.main_out) == 0 ? 0 : 1;
+
+  // set up workers
+  pool.workers = malloc (pool.n_workers * sizeof (*pool.workers));
+  if (!pool.workers)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      out_free (&pool.main_out);
+      return 1;
+    }
+
+  for (int i = 0; i < pool.n_workers; ++i)
+    {
+      if (worker_init (&pool.workers[i], &pool, i, term) != 0)
+        {
+          while (i--)
+            worker_free (&pool.workers[i]);
+
+          free (pool.workers);
+          out_free (&pool.main_out);
+          return 1;
+        }
+    }
+
+  // the root's output has to precede anything the workers print
+  if (out_flush (&pool.main_out) != 0)
+    {
+      pool.failed = 1;
+      goto cleanup;
+    }
+
+  // seed the first worker with the root directory
+  struct task *root_task = create_task (root, NULL, dev, ino, &usage);
+  if (!root_task)
+    {
+      pool.failed = 1;
+      goto cleanup;
+    }
+
+  if (opts->ordered && emit_push (&pool, root_task) != 0)
+    {
+      free_task (root_task);
+      pool.failed = 1;
+      goto cleanup;
+    }
+
+  if (submit (&pool.workers[0], root_task) != 0)
+    {
+      free_task (root_task);
+      pool.failed = 1;
+      goto cleanup;
+    }
+
+  // run workers
+  pthread_t *threads = malloc (pool.n_workers * sizeof (*threads));
+  if (!threads)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      pool.failed = 1;
+      goto cleanup;
+    }
+
+  int n_started = 0;
+  for (; n_started < pool.n_workers; ++n_started)
+    {
+      int err = pthread_create (&threads[n_started], NULL, worker_main,
+                                &pool.workers[n_started]);
+      if (err != 0)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (err));
+          pool.failed = 1;
+          break;
+        }
+    }
+
+  // if not even a single worker could be started, nobody consumes the tasks
+  if (n_started == 0)
+    worker_main (&pool.workers[0]);
+
+  for (int i = 0; i < n_started; ++i)
+    pthread_join (threads[i], NULL);
+
+  free (threads);
+
+cleanup:
+  // free unprocessed tasks and whatever the emitter did not get to
+  for (int i = 0; i < pool.n_workers; ++i)
+    {
+      struct task *t;
+      while ((t = deque_pop (&pool.workers[i].dq)))
+        {
+          if (!opts->ordered)
+            free_task (t);
+        }
+
+      if (worker_free (&pool.workers[i]) != 0)
+        pool.failed = 1;
+    }
+
+  free (pool.workers);
+
+  // every task on the emit stack has already been unlinked from its parent
+  while (pool.emit_stack_sz > 0)
+    free_task (pool.emit_stack[--pool.emit_stack_sz]);
+
+  free (pool.emit_stack);
+
+  if (out_free (&pool.main_out) != 0)
+    pool.failed = 1;
+
+  return pool.failed ? 1 : 0;
+}
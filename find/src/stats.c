@@ -0,0 +1,113 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "find.h"
+#include "stats.h"
+
+// Counters are always kept since incrementing a thread local costs next to
+// nothing, reading the clock is only done with -stats.
+
+__thread struct find_stats thread_stats;
+
+static int timing;
+static uint64_t start_time;
+
+static struct find_stats total;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// monotonic time in nanoseconds, 0 unless phases are timed
+uint64_t
+stats_clock (void)
+{
+  if (!timing)
+    return 0;
+
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// add the time since start (as returned by stats_clock) to phase
+void
+stats_add_time (enum stats_phase phase, uint64_t start)
+{
+  if (timing)
+    thread_stats.ns[phase] += stats_clock () - start;
+}
+
+// Start counting and timing a run from zero, earlier runs in the same
+// process (whose counters were merged as well) are left out. The totals are
+// process wide, so runs with -stats must not overlap.
+void
+stats_start (void)
+{
+  pthread_mutex_lock (&stats_lock);
+  memset (&total, 0, sizeof (total));
+  pthread_mutex_unlock (&stats_lock);
+
+  memset (&thread_stats, 0, sizeof (thread_stats));
+
+  timing = 1;
+  start_time = stats_clock ();
+}
+
+// add the calling thread's counters to the totals
+void
+stats_merge (void)
+{
+  pthread_mutex_lock (&stats_lock);
+
+  total.dirs += thread_stats.dirs;
+  total.entries += thread_stats.entries;
+  total.stat_calls += thread_stats.stat_calls;
+  total.open_calls += thread_stats.open_calls;
+  total.getdents_calls += thread_stats.getdents_calls;
+  total.loop_checks += thread_stats.loop_checks;
+
+  if (thread_stats.max_active > total.max_active)
+    total.max_active = thread_stats.max_active;
+
+  for (int i = 0; i < N_PHASES; ++i)
+    total.ns[i] += thread_stats.ns[i];
+
+  pthread_mutex_unlock (&stats_lock);
+
+  memset (&thread_stats, 0, sizeof (thread_stats));
+}
+
+static double
+seconds (uint64_t ns)
+{
+  return ns / 1e9;
+}
+
+// Print the totals to stderr. Avoided stat calls are counted against one
+// stat call per entry, phase times are summed over all threads.
+void
+stats_report (void)
+{
+  double elapsed = seconds (stats_clock () - start_time);
+
+  unsigned long avoided = total.entries > total.stat_calls
+                          ? total.entries - total.stat_calls : 0;
+
+  fprintf (stderr, "%s: %lu entries in %lu directories, %.3f s, %.0f "
+                   "entries/s\n", prog_name, total.entries, total.dirs,
+           elapsed, elapsed > 0 ? total.entries / elapsed : 0.0);
+  fprintf (stderr, "%s: %lu stat calls (%lu avoided), %lu directory opens, "
+                   "%lu getdents calls\n", prog_name, total.stat_calls,
+           avoided, total.open_calls, total.getdents_calls);
+  fprintf (stderr, "%s: %lu loop checks, at most %lu active directories\n",
+           prog_name, total.loop_checks, total.max_active);
+  fprintf (stderr, "%s: time in readdir %.3f s, open %.3f s, stat %.3f s, "
+                   "matching %.3f s, output %.3f s\n", prog_name,
+           seconds (total.ns[PHASE_READDIR]), seconds (total.ns[PHASE_OPEN]),
+           seconds (total.ns[PHASE_STAT]), seconds (total.ns[PHASE_MATCH]),
+           seconds (total.ns[PHASE_OUTPUT]));
+
+  // later runs without -stats are not timed
+  timing = 0;
+}
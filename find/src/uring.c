@@ -0,0 +1,239 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "uring.h"
+
+// io_uring is used through raw system calls with locally declared record
+// layouts (see io_uring_setup(2)) rather than through liburing. Requests are
+// processed by kernel worker threads, so a single thread can keep as many
+// metadata reads in flight as the ring holds.
+
+struct linux_io_sqring_offsets
+{
+  uint32_t head, tail, ring_mask, ring_entries, flags, dropped, array, resv1;
+  uint64_t user_addr;
+};
+
+struct linux_io_cqring_offsets
+{
+  uint32_t head, tail, ring_mask, ring_entries, overflow, cqes, flags, resv1;
+  uint64_t user_addr;
+};
+
+struct linux_io_uring_params
+{
+  uint32_t sq_entries, cq_entries, flags, sq_thread_cpu, sq_thread_idle;
+  uint32_t features, wq_fd, resv[3];
+  struct linux_io_sqring_offsets sq_off;
+  struct linux_io_cqring_offsets cq_off;
+};
+
+struct linux_io_uring_sqe
+{
+  uint8_t opcode;
+  uint8_t flags;
+  uint16_t ioprio;
+  int32_t fd;
+  uint64_t addr2;       // statx: result buffer
+  uint64_t addr;        // statx: path name
+  uint32_t len;         // statx: field mask
+  uint32_t op_flags;    // statx: AT_* flags
+  uint64_t user_data;
+  uint16_t buf_index;
+  uint16_t personality;
+  int32_t splice_fd_in;
+  uint64_t addr3;
+  uint64_t pad;
+};
+
+struct linux_io_uring_cqe
+{
+  uint64_t user_data;
+  int32_t res;
+  uint32_t flags;
+};
+
+#define IORING_OFF_SQ_RING 0x00000000ULL
+#define IORING_OFF_CQ_RING 0x08000000ULL
+#define IORING_OFF_SQES    0x10000000ULL
+
+#define IORING_ENTER_GETEVENTS 1U
+#define IORING_OP_STATX 21
+
+// Set up a ring, returns -1 if io_uring is not available (errno tells why).
+int
+uring_init (struct uring *ring)
+{
+#ifdef SYS_io_uring_setup
+  struct linux_io_uring_params p;
+  memset (&p, 0, sizeof (p));
+
+  ring->fd = syscall (SYS_io_uring_setup, URING_ENTRIES, &p);
+  if (ring->fd == -1)
+    return -1;
+
+  ring->entries = p.sq_entries;
+
+  ring->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  ring->cq_ring_sz = p.cq_off.cqes
+                     + p.cq_entries * sizeof (struct linux_io_uring_cqe);
+  ring->sqes_sz = p.sq_entries * sizeof (struct linux_io_uring_sqe);
+
+  ring->sq_ring = mmap (NULL, ring->sq_ring_sz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+  ring->cq_ring = mmap (NULL, ring->cq_ring_sz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_CQ_RING);
+  ring->sqes = mmap (NULL, ring->sqes_sz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+  if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED
+      || ring->sqes == MAP_FAILED)
+    {
+      int err = errno;
+      uring_free (ring);
+      errno = err;
+      return -1;
+    }
+
+  char *sq = ring->sq_ring;
+  ring->sq_head = (unsigned *) (sq + p.sq_off.head);
+  ring->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *) (sq + p.sq_off.array);
+
+  char *cq = ring->cq_ring;
+  ring->cq_head = (unsigned *) (cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+  ring->cqes = (struct linux_io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+void
+uring_free (struct uring *ring)
+{
+  if (ring->sq_ring != MAP_FAILED)
+    munmap (ring->sq_ring, ring->sq_ring_sz);
+  if (ring->cq_ring != MAP_FAILED)
+    munmap (ring->cq_ring, ring->cq_ring_sz);
+  if (ring->sqes != MAP_FAILED)
+    munmap (ring->sqes, ring->sqes_sz);
+
+  close (ring->fd);
+}
+
+// Issue the n statx requests in reqs for names in the directory dirfd,
+// keeping the ring full and storing results as they complete. Requests are
+// submitted in the order given. Returns -1 if the ring cannot be used (any
+// longer), requests that were not carried out are then left with res set to
+// -ECANCELED. Nothing is left in flight when this returns, so the results
+// and the ring can be freed right away.
+int
+uring_statx (struct uring *ring, int dirfd, struct uring_req *reqs, size_t n,
+             int flags, unsigned mask)
+{
+#ifdef SYS_io_uring_enter
+  // requests placed in the submission queue, taken from there by the kernel
+  // and completed
+  size_t queued = 0, consumed = 0, completed = 0;
+
+  int stop = 0;    // no more requests are queued or submitted
+  int failed = 0;
+
+  for (size_t i = 0; i < n; ++i)
+    reqs[i].res = -ECANCELED;
+
+  while (completed < consumed || (!stop && queued < n))
+    {
+      // queue as many requests as may be in flight
+      unsigned tail = *ring->sq_tail;
+
+      while (!stop && queued < n && queued - completed < ring->entries)
+        {
+          unsigned idx = tail & *ring->sq_mask;
+
+          struct linux_io_uring_sqe *sqe = &ring->sqes[idx];
+          memset (sqe, 0, sizeof (*sqe));
+
+          sqe->opcode = IORING_OP_STATX;
+          sqe->fd = dirfd;
+          sqe->addr = (uintptr_t) reqs[queued].name;
+          sqe->len = mask;
+          sqe->op_flags = flags;
+          sqe->addr2 = (uintptr_t) reqs[queued].stx;
+          sqe->user_data = queued;
+
+          ring->sq_array[idx] = idx;
+
+          ++tail;
+          ++queued;
+          ++thread_stats.stat_calls;
+        }
+
+      __atomic_store_n (ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+      // submit whatever the kernel has not taken yet and wait for at least
+      // one completion
+      unsigned to_submit = stop ? 0 : queued - consumed;
+
+      int ret = syscall (SYS_io_uring_enter, ring->fd, to_submit, 1,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+      if (ret >= 0)
+        consumed += ret;
+      else if (errno == EINTR)
+        ;
+      else if ((errno == EAGAIN || errno == EBUSY) && completed < consumed)
+        ;  // resources are released as completions are reaped below
+      else if (!stop)
+        stop = failed = 1;  // requests in flight are still waited for
+      else
+        sched_yield ();     // cannot wait in the kernel, poll the queue
+
+      unsigned head = *ring->cq_head;
+      unsigned cq_tail = __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE);
+
+      for (; head != cq_tail; ++head)
+        {
+          struct linux_io_uring_cqe const *cqe
+            = &ring->cqes[head & *ring->cq_mask];
+
+          // kernels predating statx on the ring, the request is left to
+          // be carried out otherwise
+          if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+            stop = failed = 1;
+          else
+            reqs[cqe->user_data].res = cqe->res;
+
+          ++completed;
+        }
+
+      __atomic_store_n (ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+  return failed ? -1 : 0;
+#else
+  (void) ring;
+  (void) dirfd;
+  (void) reqs;
+  (void) n;
+  (void) flags;
+  (void) mask;
+
+  errno = ENOSYS;
+  return -1;
+#endif
+}
@@ -0,0 +1,1049 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "dirread.h"
+#include "dupes.h"
+#include "entry.h"
+#include "expr.h"
+#include "find.h"
+#include "format.h"
+#include "inoset.h"
+#include "output.h"
+#include "pathbuf.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "watch.h"
+
+// === Entries =================================================================
+
+// Make sure the stat fields in mask are available, all fields the entry
+// wants are fetched along with them. Dangling symlinks are described by their
+// own stat data even with -follow.
+int
+entry_stat (struct entry *e, unsigned mask)
+{
+  if ((e->have & mask) == mask)
+    return 0;
+
+  mask |= e->want;
+
+  int flags = e->follow ? 0 : AT_SYMLINK_NOFOLLOW;
+
+  if (xstatat (e->parent_fd, e->name, flags, mask, &e->stx) == -1
+      && (flags != 0
+          || xstatat (e->parent_fd, e->name, AT_SYMLINK_NOFOLLOW, mask,
+                      &e->stx) == -1))
+    {
+      return -1;
+    }
+
+  e->have = mask;
+
+  return 0;
+}
+
+// === Directories =============================================================
+
+// open the directory at path, paths exceeding PATH_MAX are opened piecewise
+// relative to each other
+static int
+open_path (char const *path)
+{
+  ++thread_stats.open_calls;
+
+  int fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd != -1 || errno != ENAMETOOLONG)
+    return fd;
+
+  char *copy = malloc (strlen (path) + 1);
+  if (!copy)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  strcpy (copy, path);
+
+  int dirfd = AT_FDCWD;
+  char *p = copy;
+
+  for (;;)
+    {
+      ++thread_stats.open_calls;
+
+      if (strlen (p) < PATH_MAX)
+        {
+          fd = openat (dirfd, p, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+          break;
+        }
+
+      // split off as many leading components as fit
+      char *cut = p + PATH_MAX - 1;
+      while (cut > p && *cut != '/')
+        --cut;
+
+      if (cut == p)
+        {
+          errno = ENAMETOOLONG;
+          break;
+        }
+
+      *cut = '\0';
+
+      int next = openat (dirfd, p, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+      if (dirfd != AT_FDCWD)
+        close (dirfd);
+
+      dirfd = next;
+      if (dirfd == -1)
+        break;
+
+      p = cut + 1;
+    }
+
+  if (dirfd != AT_FDCWD && dirfd != -1)
+    close (dirfd);
+
+  free (copy);
+
+  return fd;
+}
+
+int
+open_dir (char const *path)
+{
+  uint64_t start = stats_clock ();
+  int fd = open_path (path);
+  stats_add_time (PHASE_OPEN, start);
+
+  return fd;
+}
+
+// === Loop detection ==========================================================
+
+// A directory closes a loop iff it is one of its own ancestors, active is the
+// set of (dev, ino) pairs of all directories on the path to the current one.
+static int
+check_loop (char const *path, dev_t dev, ino_t ino,
+            struct ino_set const *active)
+{
+  ++thread_stats.loop_checks;
+
+  if (active->used > thread_stats.max_active)
+    thread_stats.max_active = active->used;
+
+  if (!ino_set_contains (active, dev, ino))
+    return 0;
+
+  int parent_len = strrchr (path, '/') - path;
+
+  fprintf (stderr,
+           "%s: File system loop detected; "
+           "‘%s’ is part of the same file system loop as ‘%.*s’.\n",
+           prog_name, path, parent_len, path);
+
+  return 1;
+}
+
+// === Entry visitor ===========================================================
+
+// stat fields fetched whenever an entry is stat'ed
+unsigned
+entry_mask (struct find_opts const *opts)
+{
+  unsigned mask = opts->expr->stat_mask | STATX_TYPE;
+
+  // device and inode of directories for -follow and -xdev
+  if (opts->follow || opts->xdev)
+    mask |= STATX_INO;
+
+  // -dupes needs the size and identity of every matching file
+  if (opts->dupes)
+    mask |= STATX_SIZE | STATX_INO;
+
+  // as does -du for every entry
+  if (opts->du)
+    mask |= STATX_SIZE | STATX_BLOCKS | STATX_NLINK | STATX_INO;
+
+  // and -printf and -format for every matching entry
+  if (opts->format)
+    mask |= opts->format->stat_mask;
+
+  return mask;
+}
+
+// Determine the type of a single entry, run loop detection and the
+// expression on it and decide whether it has to be descended into. d_type is
+// the type reported by the directory listing (or DT_UNKNOWN), stx the stat
+// data of the entry if it has been fetched ahead (following symlinks with
+// -follow, with the fields of entry_mask) or NULL. The entry is only stat'ed
+// if that is inconclusive, if it is a symlink that has to be
+// followed, if it is a directory to be descended into whose device and inode
+// are needed for -follow or -xdev or if the expression needs stat data. Each
+// stat call only asks for the fields needed by the expression and the
+// traversal.
+// depth is the number of levels below the starting point. active holds the
+// directories on the path to the entry (only used with -follow). Returns a
+// combination of VISIT_* flags or -1 on fatal errors. The entry is set up in
+// *e, which the caller prints if it matches. The device and inode of a
+// directory that should be descended into are stored in *dev and *ino, with
+// -du the usage of the entry is stored in *usage.
+int
+visit (struct find_opts const *opts, int parent_fd, char const *file,
+       char const *path, unsigned char d_type, struct linux_statx const *stx,
+       int depth, struct ino_set const *active, struct entry *e, dev_t *dev,
+       ino_t *ino, struct du_sum *usage)
+{
+  e->parent_fd = parent_fd;
+  e->name = file;
+  e->path = path;
+  e->follow = opts->follow;
+  e->have = 0;
+  e->want = entry_mask (opts);
+  e->prune = 0;
+
+  usage->apparent = usage->allocated = 0;
+
+  ++thread_stats.entries;
+
+  // determine type of the entry itself
+  e->ltype = d_type;
+
+  // prefetched stat data describes the symlink target with -follow, the
+  // type of the entry itself then has to be known
+  if (stx && !(e->ltype == DT_UNKNOWN && opts->follow))
+    {
+      e->stx = *stx;
+      e->have = e->want;
+
+      if (e->ltype == DT_UNKNOWN)
+        e->ltype = IFTODT (stx->stx_mode);
+    }
+
+  if (e->ltype == DT_UNKNOWN)
+    {
+      if (xstatat (parent_fd, file, AT_SYMLINK_NOFOLLOW, e->want, &e->stx) == -1)
+        return 0;
+
+      e->ltype = IFTODT (e->stx.stx_mode);
+      e->have = (e->ltype != DT_LNK || !opts->follow) ? e->want : 0;
+    }
+
+  // determine type of the symlink target
+  e->type = e->ltype;
+
+  if (e->ltype == DT_LNK && opts->follow)
+    {
+      struct linux_statx target;
+      if (stx)
+        {
+          e->stx = *stx;
+          e->type = IFTODT (stx->stx_mode);
+          e->have = e->want;
+        }
+      else if (xstatat (parent_fd, file, 0, e->want, &target) != -1)
+        {
+          e->stx = target;
+          e->type = IFTODT (target.stx_mode);
+          e->have = e->want;
+        }
+    }
+
+  // directories at -maxdepth are treated like any other file
+  int is_dir = (e->type == DT_DIR && depth < opts->max_depth);
+
+  // device and inode of directories are only needed for -follow and -xdev
+  if (is_dir && (opts->follow || opts->xdev))
+    {
+      if (entry_stat (e, STATX_INO) != 0)
+        return 0;
+    }
+
+  dev_t e_dev = (e->have & STATX_INO) ? xstat_dev (&e->stx) : 0;
+
+  // check for file system loops
+  if (opts->follow && is_dir && check_loop (path, e_dev, e->stx.stx_ino,
+                                             active))
+    {
+      return 0;
+    }
+
+  int flags = 0;
+
+  // print name of matching files, stat calls made on the way are not
+  // counted as matching time
+  if (depth >= opts->min_depth && depth <= opts->eval_depth)
+    {
+      uint64_t start = stats_clock ();
+      uint64_t stat_ns = thread_stats.ns[PHASE_STAT];
+
+      if (expr_eval (opts->expr, e))
+        flags |= VISIT_MATCH;
+
+      stats_add_time (PHASE_MATCH,
+                      start + (thread_stats.ns[PHASE_STAT] - stat_ns));
+    }
+
+  // with -dupes, matching regular files are collected rather than printed
+  if ((flags & VISIT_MATCH) && opts->dupes)
+    {
+      flags &= ~VISIT_MATCH;
+
+      if (e->type == DT_REG && entry_stat (e, STATX_SIZE | STATX_INO) == 0
+          && dupes_add (opts->dupes, path, e->stx.stx_size, xstat_dev (&e->stx),
+                        e->stx.stx_ino) != 0)
+        {
+          return -1;
+        }
+    }
+
+  if (opts->du && du_usage (opts->du, e, usage) != 0)
+    return -1;
+
+  // embedding programs get matching entries handed to them, they may prune
+  // directories by setting e->prune
+  if ((flags & VISIT_MATCH) && opts->on_match)
+    {
+      flags &= ~VISIT_MATCH;
+
+      if (opts->on_match (e, opts->arg) != 0)
+        return -1;
+    }
+
+  // records are built from the stat data of the entry, entries that cannot
+  // be stat'ed are not printed
+  if ((flags & VISIT_MATCH) && opts->format
+      && entry_stat (e, opts->format->stat_mask) != 0)
+    {
+      flags &= ~VISIT_MATCH;
+    }
+
+  // stop recursion for non-directories and pruned directories
+  if (!is_dir || e->prune)
+    return flags;
+
+  // stop at file system boundaries when -xdev is set
+  if (opts->xdev && e_dev != opts->dev)
+    return flags;
+
+  if (e->have & STATX_INO)
+    {
+      *dev = e_dev;
+      *ino = e->stx.stx_ino;
+    }
+  else
+    {
+      *dev = 0;
+      *ino = 0;
+    }
+
+  return flags | VISIT_DESCEND;
+}
+
+// === Sequential find function ================================================
+
+// Directories are traversed iteratively with an explicit stack holding one
+// frame per directory being read. Only the deepest directories on the stack
+// are kept open, shallower ones are closed once more than budget directories
+// would be open and are reopened (and repositioned) when the traversal
+// returns to them.
+//
+// The traversal either runs to completion, printing matching entries, or is
+// stepped by walker_next, which stops at each matching entry and holds back
+// descending into it until the next step (so that it can still be pruned).
+
+#define DIR_FD_MAX 128  // upper limit on directories open at a time
+#define FD_RESERVE 32   // descriptors left for output, watches and the like
+
+struct frame
+{
+  int fd;                 // -1 while closed
+  struct dir_reader *dr;  // NULL while closed or if the directory is listed
+  off_t off;              // where to continue reading after reopening
+
+  // with -inode-order and -uring, the entries of the directory (and their
+  // stat data) are read up front, the list is kept with the frame's slot
+  int listed;
+  struct prefetch_list list;
+
+  size_t path_len;        // length of the directory's path
+  int depth;
+
+  // identity of the directory, used for loop detection (-follow) and to
+  // verify the directory after reopening it
+  dev_t dev;
+  ino_t ino;
+  int have_id;
+
+  struct du_sum sum;      // -du, usage of the directory and its entries
+};
+
+// directory to be descended into once the entry naming it has been handed out
+struct pending
+{
+  int parent_fd;
+  char const *name;
+  int depth;
+  dev_t dev;
+  ino_t ino;
+  struct du_sum usage;
+};
+
+struct walker
+{
+  struct find_opts opts;
+
+  struct frame *frames;
+  int n_frames, cap_frames;
+
+  // frames [first_open, n_frames) are open
+  int first_open;
+  int budget;
+
+  // readers not currently used by an open frame, at most budget readers
+  // exist
+  struct dir_reader **readers;
+  int n_readers, n_free_readers;
+
+  // directories on the path to the current one (-follow only)
+  struct ino_set active;
+
+  // path of the entry currently being visited
+  struct path_buf path;
+  struct entry entry;
+
+  struct out_buf out;
+
+  // -inode-order and -uring only
+  struct prefetch pf;
+
+  // walker_next only
+  int started;
+  int matched;  // w->entry is handed out
+  struct pending next;
+  int have_next;
+};
+
+static int
+fd_budget (void)
+{
+  int n = DIR_FD_MAX;
+
+  struct rlimit rl;
+  if (getrlimit (RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+      && rl.rlim_cur < (rlim_t) DIR_FD_MAX + FD_RESERVE)
+    {
+      n = (int) rl.rlim_cur - FD_RESERVE;
+    }
+
+  return n < 1 ? 1 : n;
+}
+
+static struct dir_reader *
+get_reader (struct walker *w)
+{
+  if (w->n_free_readers > 0)
+    return w->readers[--w->n_free_readers];
+
+  if (!w->readers
+      && !(w->readers = malloc (w->budget * sizeof (*w->readers))))
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  struct dir_reader *dr = malloc (sizeof (*dr));
+  if (!dr)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  if (dir_reader_init (dr) != 0)
+    {
+      free (dr);
+      return NULL;
+    }
+
+  ++w->n_readers;
+
+  return dr;
+}
+
+static void
+put_reader (struct walker *w, struct dir_reader *dr)
+{
+  w->readers[w->n_free_readers++] = dr;
+}
+
+static void
+free_readers (struct walker *w)
+{
+  for (int i = 0; i < w->n_free_readers; ++i)
+    {
+      dir_reader_free (w->readers[i]);
+      free (w->readers[i]);
+    }
+
+  free (w->readers);
+
+  w->readers = NULL;
+  w->n_readers = w->n_free_readers = 0;
+}
+
+// close the shallowest open directory, buffered entries are dropped and read
+// again after reopening
+static void
+evict (struct walker *w)
+{
+  struct frame *f = &w->frames[w->first_open++];
+
+  if (!f->have_id)
+    {
+      struct stat sb;
+      if (fstat (f->fd, &sb) == 0)
+        {
+          f->dev = sb.st_dev;
+          f->ino = sb.st_ino;
+          f->have_id = 1;
+        }
+    }
+
+  if (!f->listed)
+    {
+      f->off = f->dr->off;
+
+      put_reader (w, f->dr);
+      f->dr = NULL;
+    }
+
+  close (f->fd);
+  f->fd = -1;
+}
+
+// Reopen the directory of the top frame (the only one left when all open
+// frames above it have been finished), the walker's path must hold its path.
+// Returns 1 if the directory is gone or has been replaced.
+static int
+reopen (struct walker *w)
+{
+  int k = w->n_frames - 1;
+  struct frame *f = &w->frames[k];
+
+  int fd = open_dir (w->path.buf);
+  if (fd == -1)
+    return 1;
+
+  struct stat sb;
+  if (f->have_id && (fstat (fd, &sb) == -1 || sb.st_dev != f->dev
+                     || sb.st_ino != f->ino))
+    {
+      fprintf (stderr, "%s: ‘%s’ changed during traversal, skipping it\n",
+               prog_name, w->path.buf);
+      close (fd);
+      return 1;
+    }
+
+  // listed directories continue from their list
+  if (f->listed)
+    {
+      f->fd = fd;
+      w->first_open = k;
+
+      return 0;
+    }
+
+  struct dir_reader *dr = get_reader (w);
+  if (!dr)
+    {
+      close (fd);
+      return -1;
+    }
+
+  if (dir_reader_seek (dr, fd, f->off) != 0)
+    {
+      put_reader (w, dr);
+      close (fd);
+      return 1;
+    }
+
+  f->fd = fd;
+  f->dr = dr;
+
+  w->first_open = k;
+
+  return 0;
+}
+
+// start reading the directory file in parent_fd, which has just been visited
+// (the walker's path holds its path), usage is that of the directory itself
+static int
+descend (struct walker *w, int parent_fd, char const *file, int depth,
+         dev_t dev, ino_t ino, struct du_sum const *usage)
+{
+  struct find_opts const *opts = &w->opts;
+
+  uint64_t start = stats_clock ();
+
+  int fd = openat (parent_fd, file, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  stats_add_time (PHASE_OPEN, start);
+  ++thread_stats.open_calls;
+
+  if (fd == -1)
+    return 0;
+
+  ++thread_stats.dirs;
+
+  // watch the directory before reading it so that no later change is missed
+  if (opts->watch && watch_add (opts->watch, w->path.buf, depth) != 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  if (w->n_frames == w->cap_frames)
+    {
+      int cap = w->cap_frames ? 2 * w->cap_frames : 64;
+
+      struct frame *tmp = realloc (w->frames, cap * sizeof (*tmp));
+      if (!tmp)
+        {
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          close (fd);
+          return -1;
+        }
+
+      for (int i = w->cap_frames; i < cap; ++i)
+        prefetch_list_init (&tmp[i].list);
+
+      w->frames = tmp;
+      w->cap_frames = cap;
+    }
+
+  if (w->n_frames - w->first_open == w->budget)
+    evict (w);
+
+  int listed = opts->inode_order || opts->uring;
+
+  struct dir_reader *dr = NULL;
+  if (!listed && !(dr = get_reader (w)))
+    {
+      close (fd);
+      return -1;
+    }
+
+  // keep track of the active path for loop detection
+  if (opts->follow && ino_set_insert (&w->active, dev, ino) == -1)
+    {
+      if (dr)
+        put_reader (w, dr);
+
+      close (fd);
+      return -1;
+    }
+
+  struct frame *f = &w->frames[w->n_frames];
+
+  if (listed && prefetch_dir (&w->pf, &f->list, opts, fd) != 0)
+    {
+      if (opts->follow)
+        ino_set_remove (&w->active, dev, ino);
+
+      close (fd);
+      return -1;
+    }
+
+  if (dr)
+    dir_reader_reset (dr, fd);
+
+  ++w->n_frames;
+
+  f->fd = fd;
+  f->dr = dr;
+  f->off = 0;
+  f->listed = listed;
+  f->path_len = w->path.len;
+  f->depth = depth;
+  f->dev = dev;
+  f->ino = ino;
+  f->have_id = (dev != 0 || ino != 0);
+  f->sum = *usage;
+
+  return 0;
+}
+
+// with -du, record the usage of the top frame's directory (the walker's path
+// must hold its path)
+static int
+record_usage (struct walker *w)
+{
+  struct frame const *f = &w->frames[w->n_frames - 1];
+
+  if (!w->opts.du)
+    return 0;
+
+  return du_add_dir (w->opts.du, w->path.buf, f->depth, &f->sum);
+}
+
+static void
+ascend (struct walker *w)
+{
+  struct frame *f = &w->frames[--w->n_frames];
+
+  if (f->fd != -1)
+    {
+      close (f->fd);
+
+      if (f->dr)
+        put_reader (w, f->dr);
+    }
+
+  if (w->opts.follow)
+    ino_set_remove (&w->active, f->dev, f->ino);
+
+  if (w->first_open > w->n_frames)
+    w->first_open = w->n_frames;
+}
+
+// Walk until all frames are done or, if a matching entry is handed out by
+// walker_next, until the first such entry. Returns 1 on errors.
+static int
+walk (struct walker *w)
+{
+  while (w->n_frames > 0)
+    {
+      struct frame *f = &w->frames[w->n_frames - 1];
+
+      path_buf_truncate (&w->path, f->path_len);
+
+      if (f->fd == -1)
+        {
+          int ret = reopen (w);
+          if (ret == -1)
+            return 1;
+
+          if (ret == 1)
+            {
+              if (record_usage (w) != 0)
+                return 1;
+
+              ascend (w);
+              continue;
+            }
+        }
+
+      struct dir_entry entry;
+      struct linux_statx const *stx = NULL;
+
+      int ret = f->listed ? prefetch_next (&f->list, &entry, &stx)
+                          : dir_read (f->dr, &entry);
+      if (ret == -1)
+        return 1;
+
+      if (ret == 0)
+        {
+          if (record_usage (w) != 0)
+            return 1;
+
+          ascend (w);
+          continue;
+        }
+
+      // extend pathname
+      if (path_buf_push (&w->path, entry.name) != 0)
+        return 1;
+
+      dev_t dev;
+      ino_t ino;
+      struct du_sum usage;
+
+      int flags = visit (&w->opts, f->fd, entry.name, w->path.buf,
+                         entry.type, stx, f->depth + 1, &w->active, &w->entry,
+                         &dev, &ino, &usage);
+      if (flags == -1)
+        return 1;
+
+      if ((flags & VISIT_MATCH)
+          && out_entry (&w->out, w->opts.format, &w->entry, w->path.len) != 0)
+        {
+          return 1;
+        }
+
+      // a handed out directory is descended into by the next step
+      if ((flags & VISIT_DESCEND) && w->matched)
+        {
+          w->next = (struct pending)
+            { f->fd, entry.name, f->depth + 1, dev, ino, usage };
+          w->have_next = 1;
+
+          return 0;
+        }
+
+      // directories that are read account for their own usage, everything
+      // else is charged to the directory containing it
+      int n = w->n_frames;
+
+      if ((flags & VISIT_DESCEND)
+          && descend (w, f->fd, entry.name, f->depth + 1, dev, ino,
+                      &usage) != 0)
+        {
+          return 1;
+        }
+
+      if (w->n_frames == n)
+        {
+          f = &w->frames[n - 1];
+          f->sum.apparent += usage.apparent;
+          f->sum.allocated += usage.allocated;
+        }
+
+      if (w->matched)
+        return 0;
+    }
+
+  return 0;
+}
+
+// Set up a walker for the tree below root_path, returns NULL on errors.
+// opts is copied.
+static struct walker *
+walker_init (struct find_opts const *opts, char const *root_path)
+{
+  struct walker *w = calloc (1, sizeof (*w));
+  if (!w)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return NULL;
+    }
+
+  w->opts = *opts;
+
+  if (ino_set_init (&w->active) != 0)
+    {
+      free (w);
+      return NULL;
+    }
+
+  if (path_buf_init (&w->path) != 0
+      || path_buf_set (&w->path, root_path) != 0)
+    {
+      path_buf_free (&w->path);
+      ino_set_free (&w->active);
+      free (w);
+      return NULL;
+    }
+
+  if (out_init (&w->out, STDOUT_FILENO, opts->print0 ? '\0' : '\n') != 0)
+    {
+      path_buf_free (&w->path);
+      ino_set_free (&w->active);
+      free (w);
+      return NULL;
+    }
+
+  w->budget = fd_budget ();
+
+  prefetch_init (&w->pf);
+
+  return w;
+}
+
+// returns -1 if the remaining output could not be written
+static int
+walker_free (struct walker *w)
+{
+  while (w->n_frames > 0)
+    ascend (w);
+
+  int err = out_free (&w->out);
+
+  path_buf_free (&w->path);
+  ino_set_free (&w->active);
+  free_readers (w);
+  prefetch_free (&w->pf);
+
+  for (int i = 0; i < w->cap_frames; ++i)
+    prefetch_list_free (&w->frames[i].list);
+
+  free (w->frames);
+  free (w);
+
+  return err;
+}
+
+// Traverse the tree starting at the entry file in the directory parent_fd,
+// root_path is the path under which the entry is reported and depth its
+// depth below the starting point.
+int
+find_seq_at (struct find_opts const *opts, int parent_fd, char const *file,
+             char const *root_path, int depth)
+{
+  struct walker *w = walker_init (opts, root_path);
+  if (!w)
+    return 1;
+
+  // output printed so far precedes that of commands run by -exec
+  if (!opts->on_match && !opts->dupes)
+    out_bind (&w->out, opts->format);
+
+  int err = 0;
+
+  dev_t dev;
+  ino_t ino;
+  struct du_sum usage;
+
+  int flags = visit (opts, parent_fd, file, w->path.buf, DT_UNKNOWN, NULL,
+                     depth, &w->active, &w->entry, &dev, &ino, &usage);
+  if (flags == -1)
+    err = 1;
+  else if ((flags & VISIT_MATCH)
+           && out_entry (&w->out, opts->format, &w->entry, w->path.len) != 0)
+    {
+      err = 1;
+    }
+  else if ((flags & VISIT_DESCEND)
+           && descend (w, parent_fd, file, depth, dev, ino, &usage) != 0)
+    {
+      err = 1;
+    }
+
+  if (!err)
+    err = walk (w);
+
+  out_bind (NULL, NULL);
+
+  if (walker_free (w) != 0)
+    err = 1;
+
+  stats_merge ();
+
+  return err;
+}
+
+int
+find_seq (struct find_opts const *opts, char *root)
+{
+  return find_seq_at (opts, AT_FDCWD, root, root, 0);
+}
+
+// === Stepwise traversal ======================================================
+
+// the entry being visited is handed out by walker_next
+static int
+take_match (struct entry *e, void *arg)
+{
+  struct walker *w = arg;
+
+  w->matched = 1;
+
+  return 0;
+}
+
+// Set up stepping through the tree at root with walker_next, entries for
+// which the expression is true are handed out rather than printed.
+struct walker *
+walker_open (struct find_opts const *opts, char const *root)
+{
+  struct walker *w = walker_init (opts, root);
+  if (!w)
+    return NULL;
+
+  w->opts.on_match = take_match;
+  w->opts.arg = w;
+
+  return w;
+}
+
+// Advance to the next matching entry and store it in *e, it stays valid
+// until the next call. Returns 1 if there is an entry, 0 at the end of the
+// traversal and -1 on errors.
+int
+walker_next (struct walker *w, struct entry **e)
+{
+  w->matched = 0;
+
+  if (!w->started)
+    {
+      w->started = 1;
+
+      dev_t dev;
+      ino_t ino;
+      struct du_sum usage;
+
+      char const *root = w->path.buf;
+
+      int flags = visit (&w->opts, AT_FDCWD, root, root, DT_UNKNOWN, NULL, 0,
+                         &w->active, &w->entry, &dev, &ino, &usage);
+      if (flags == -1)
+        return -1;
+
+      if (flags & VISIT_DESCEND)
+        {
+          w->next = (struct pending) { AT_FDCWD, root, 0, dev, ino, usage };
+          w->have_next = 1;
+        }
+
+      if (w->matched)
+        {
+          *e = &w->entry;
+          return 1;
+        }
+    }
+
+  if (w->have_next)
+    {
+      w->have_next = 0;
+
+      struct pending const *p = &w->next;
+
+      int n = w->n_frames;
+
+      if (descend (w, p->parent_fd, p->name, p->depth, p->dev, p->ino,
+                   &p->usage) != 0)
+        {
+          return -1;
+        }
+
+      // directories that cannot be opened are charged to their parent
+      if (w->n_frames == n && n > 0)
+        {
+          w->frames[n - 1].sum.apparent += p->usage.apparent;
+          w->frames[n - 1].sum.allocated += p->usage.allocated;
+        }
+    }
+
+  if (walk (w) != 0)
+    return -1;
+
+  if (!w->matched)
+    return 0;
+
+  *e = &w->entry;
+
+  return 1;
+}
+
+// do not descend into the directory handed out last
+void
+walker_prune (struct walker *w)
+{
+  w->have_next = 0;
+}
+
+void
+walker_close (struct walker *w)
+{
+  walker_free (w);
+  stats_merge ();
+}
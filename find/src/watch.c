@@ -0,0 +1,297 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "find.h"
+#include "pathbuf.h"
+#include "watch.h"
+
+#define EVENT_BUF_SZ (64 * 1024)
+
+// record layout returned by reading from an inotify instance
+struct linux_inotify_event
+{
+  int32_t wd;
+  uint32_t mask;
+  uint32_t cookie;
+  uint32_t len;
+  char name[];
+};
+
+// inotify flags, see inotify(7)
+#define IN_CLOSE_WRITE 0x00000008
+#define IN_MOVED_FROM  0x00000040
+#define IN_MOVED_TO    0x00000080
+#define IN_CREATE      0x00000100
+#define IN_Q_OVERFLOW  0x00004000
+#define IN_IGNORED     0x00008000
+#define IN_ONLYDIR     0x01000000
+#define IN_ISDIR       0x40000000
+
+// events that may turn up new or changed entries
+#define WATCH_MASK \
+  (IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR)
+
+// === Watch table =============================================================
+
+int
+watch_init (struct watcher *w)
+{
+  w->fd = syscall (SYS_inotify_init1, O_CLOEXEC);
+  if (w->fd == -1)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  pthread_mutex_init (&w->lock, NULL);
+
+  w->dirs = NULL;
+  w->n_dirs = w->n_watched = 0;
+  w->full = 0;
+
+  return 0;
+}
+
+void
+watch_free (struct watcher *w)
+{
+  close (w->fd);
+
+  for (int i = 0; i < w->n_dirs; ++i)
+    free (w->dirs[i].path);
+
+  free (w->dirs);
+
+  pthread_mutex_destroy (&w->lock);
+}
+
+// Watch the directory at path, which is depth levels below the starting
+// point. Directories that cannot be watched are skipped with a warning (only
+// given once if the watch limit is reached).
+int
+watch_add (struct watcher *w, char const *path, int depth)
+{
+  int wd = syscall (SYS_inotify_add_watch, w->fd, path, WATCH_MASK);
+  if (wd == -1)
+    {
+      if (errno == ENOSPC)
+        {
+          pthread_mutex_lock (&w->lock);
+
+          if (!w->full)
+            {
+              fprintf (stderr, "%s: inotify watch limit reached, changes in "
+                               "some directories will be missed\n",
+                       prog_name);
+              w->full = 1;
+            }
+
+          pthread_mutex_unlock (&w->lock);
+        }
+      else if (errno != ENOENT && errno != ENOTDIR)
+        fprintf (stderr, "%s: %s: %s\n", prog_name, path, strerror (errno));
+
+      return 0;
+    }
+
+  char *copy = malloc (strlen (path) + 1);
+  if (!copy)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return -1;
+    }
+
+  strcpy (copy, path);
+
+  pthread_mutex_lock (&w->lock);
+
+  if (wd >= w->n_dirs)
+    {
+      int n = w->n_dirs ? w->n_dirs : 64;
+      while (wd >= n)
+        n *= 2;
+
+      struct watch_dir *tmp = realloc (w->dirs, n * sizeof (*tmp));
+      if (!tmp)
+        {
+          pthread_mutex_unlock (&w->lock);
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          free (copy);
+          return -1;
+        }
+
+      memset (tmp + w->n_dirs, 0, (n - w->n_dirs) * sizeof (*tmp));
+
+      w->dirs = tmp;
+      w->n_dirs = n;
+    }
+
+  // a directory that is watched already (e.g. after it was moved) gets the
+  // same descriptor again
+  if (w->dirs[wd].path)
+    free (w->dirs[wd].path);
+  else
+    ++w->n_watched;
+
+  w->dirs[wd].path = copy;
+  w->dirs[wd].depth = depth;
+
+  pthread_mutex_unlock (&w->lock);
+
+  return 0;
+}
+
+static void
+watch_drop (struct watcher *w, int wd)
+{
+  if (wd < 0 || wd >= w->n_dirs || !w->dirs[wd].path)
+    return;
+
+  free (w->dirs[wd].path);
+  w->dirs[wd].path = NULL;
+
+  --w->n_watched;
+}
+
+// stop watching the directory at path and everything below it
+static void
+watch_drop_tree (struct watcher *w, char const *path, size_t len)
+{
+  for (int wd = 0; wd < w->n_dirs; ++wd)
+    {
+      char const *p = w->dirs[wd].path;
+
+      if (p && strncmp (p, path, len) == 0 && (p[len] == '\0' || p[len] == '/'))
+        {
+          syscall (SYS_inotify_rm_watch, w->fd, wd);
+          watch_drop (w, wd);
+        }
+    }
+}
+
+// === Event loop ==============================================================
+
+static int
+handle_event (struct find_opts const *opts, struct watcher *w,
+              struct linux_inotify_event const *ev, struct path_buf *path)
+{
+  if (ev->mask & IN_IGNORED)
+    {
+      watch_drop (w, ev->wd);
+      return 0;
+    }
+
+  if (ev->len == 0 || ev->wd < 0 || ev->wd >= w->n_dirs
+      || !w->dirs[ev->wd].path)
+    {
+      return 0;
+    }
+
+  char const *dir = w->dirs[ev->wd].path;
+  int depth = w->dirs[ev->wd].depth + 1;
+
+  if (path_buf_set (path, dir) != 0 || path_buf_push (path, ev->name) != 0)
+    return -1;
+
+  // directories moved away are picked up again wherever they reappear
+  if (ev->mask & IN_MOVED_FROM)
+    {
+      if (ev->mask & IN_ISDIR)
+        watch_drop_tree (w, path->buf, path->len);
+
+      return 0;
+    }
+
+  int dirfd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd == -1)
+    return 0;
+
+  // regular files are reported once they have been written and closed
+  if ((ev->mask & IN_CREATE) && !(ev->mask & IN_ISDIR))
+    {
+      struct stat sb;
+      if (fstatat (dirfd, ev->name, &sb, AT_SYMLINK_NOFOLLOW) == -1
+          || S_ISREG (sb.st_mode))
+        {
+          close (dirfd);
+          return 0;
+        }
+    }
+
+  // new directories are traversed (and watched) like the initial tree, this
+  // also reports whatever was created in them before the watch was in place
+  int err = find_seq_at (opts, dirfd, ev->name, path->buf, depth);
+
+  close (dirfd);
+
+  return err == 0 ? 0 : -1;
+}
+
+// Print entries matching the expression as they are created, modified or
+// moved into the tree, until no directory of the tree is watched anymore.
+int
+watch_run (struct find_opts const *opts, struct watcher *w)
+{
+  char *buf = malloc (EVENT_BUF_SZ);
+  if (!buf)
+    {
+      fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+      return 1;
+    }
+
+  struct path_buf path;
+  if (path_buf_init (&path) != 0)
+    {
+      free (buf);
+      return 1;
+    }
+
+  int err = 0;
+
+  while (!err && w->n_watched > 0)
+    {
+      ssize_t n = read (w->fd, buf, EVENT_BUF_SZ);
+      if (n == -1)
+        {
+          if (errno == EINTR)
+            continue;
+
+          fprintf (stderr, "%s: %s\n", prog_name, strerror (errno));
+          err = 1;
+          break;
+        }
+
+      for (char *p = buf; p < buf + n && !err; )
+        {
+          struct linux_inotify_event const *ev = (void const *) p;
+
+          if (ev->mask & IN_Q_OVERFLOW)
+            {
+              fprintf (stderr, "%s: inotify event queue overflowed, some "
+                               "changes were missed\n", prog_name);
+            }
+
+          if (handle_event (opts, w, ev, &path) != 0)
+            err = 1;
+
+          p += sizeof (*ev) + ev->len;
+        }
+
+      // commands of -exec ... {} + are not held back until the next event
+      if (expr_flush (opts->expr) != 0)
+        err = 1;
+    }
+
+  path_buf_free (&path);
+  free (buf);
+
+  return err;
+}
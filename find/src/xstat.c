@@ -0,0 +1,91 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "xstat.h"
+
+// cleared once statx turns out to be unavailable
+static int have_statx = 1;
+
+// fill the statx record from struct stat for kernels without statx
+static int
+xstat_fallback (int dirfd, char const *name, int flags,
+                struct linux_statx *stx)
+{
+  struct stat sb;
+  if (fstatat (dirfd, name, &sb, flags) == -1)
+    return -1;
+
+  memset (stx, 0, sizeof (*stx));
+
+  stx->stx_mask = STATX_BASIC_STATS;
+  stx->stx_blksize = sb.st_blksize;
+  stx->stx_mode = sb.st_mode;
+  stx->stx_nlink = sb.st_nlink;
+  stx->stx_uid = sb.st_uid;
+  stx->stx_gid = sb.st_gid;
+  stx->stx_ino = sb.st_ino;
+  stx->stx_size = sb.st_size;
+  stx->stx_blocks = sb.st_blocks;
+  stx->stx_atime.tv_sec = sb.st_atim.tv_sec;
+  stx->stx_atime.tv_nsec = sb.st_atim.tv_nsec;
+  stx->stx_mtime.tv_sec = sb.st_mtim.tv_sec;
+  stx->stx_mtime.tv_nsec = sb.st_mtim.tv_nsec;
+  stx->stx_ctime.tv_sec = sb.st_ctim.tv_sec;
+  stx->stx_ctime.tv_nsec = sb.st_ctim.tv_nsec;
+  stx->stx_rdev_major = major (sb.st_rdev);
+  stx->stx_rdev_minor = minor (sb.st_rdev);
+  stx->stx_dev_major = major (sb.st_dev);
+  stx->stx_dev_minor = minor (sb.st_dev);
+
+  return 0;
+}
+
+static int
+xstat_call (int dirfd, char const *name, int flags, unsigned mask,
+            struct linux_statx *stx)
+{
+#ifdef SYS_statx
+  if (__atomic_load_n (&have_statx, __ATOMIC_RELAXED))
+    {
+      if (syscall (SYS_statx, dirfd, name, flags, mask, stx) == 0)
+        return 0;
+
+      if (errno != ENOSYS)
+        return -1;
+
+      __atomic_store_n (&have_statx, 0, __ATOMIC_RELAXED);
+    }
+#else
+  (void) mask;
+  (void) have_statx;
+#endif
+
+  return xstat_fallback (dirfd, name, flags, stx);
+}
+
+// Fetch (at least) the fields in mask of name in dirfd, flags are those of
+// fstatat. Sets errno and returns -1 on errors.
+int
+xstatat (int dirfd, char const *name, int flags, unsigned mask,
+         struct linux_statx *stx)
+{
+  ++thread_stats.stat_calls;
+
+  uint64_t start = stats_clock ();
+  int ret = xstat_call (dirfd, name, flags, mask, stx);
+  stats_add_time (PHASE_STAT, start);
+
+  return ret;
+}
+
+dev_t
+xstat_dev (struct linux_statx const *stx)
+{
+  return makedev (stx->stx_dev_major, stx->stx_dev_minor);
+}